@@ -0,0 +1,117 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Minimal DDS container support for the block compressed textures written by tools/texture_cooker.cpp.
+// Only the two formats the cooker produces are understood: DXT1 (BC1, opaque) and DXT5 (BC3, with alpha),
+// each with a full mip chain stored largest level first.
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+const uint32_t DDS_FOURCC_DXT1 = 0x31545844;
+const uint32_t DDS_FOURCC_DXT5 = 0x35545844;
+
+const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000,
+               DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+struct DdsPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask, gBitMask, bBitMask, aBitMask;
+};
+
+struct DdsHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat pixelFormat;
+    uint32_t caps, caps2, caps3, caps4;
+    uint32_t reserved2;
+};
+
+enum class DdsFormat { BC1, BC3 };
+
+struct DdsLevel {
+    uint32_t width, height;
+    size_t offset;  // from the start of the file
+    size_t size;
+};
+
+struct DdsImage {
+    DdsFormat format;
+    uint32_t width, height;
+    std::vector<DdsLevel> levels;
+};
+
+inline size_t DdsBlockBytes(DdsFormat format)
+{
+    return format == DdsFormat::BC1 ? 8 : 16;
+}
+
+inline size_t DdsLevelSize(DdsFormat format, uint32_t width, uint32_t height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * DdsBlockBytes(format);
+}
+
+// parses the header and lays out the mip levels; returns false for anything the cooker wouldn't have written
+inline bool DdsParse(const unsigned char *data, size_t size, DdsImage &image)
+{
+    if (size < 4 + sizeof(DdsHeader))
+        return false;
+    uint32_t magic;
+    DdsHeader header;
+    std::memcpy(&magic, data, 4);
+    std::memcpy(&header, data + 4, sizeof(DdsHeader));
+    if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || !(header.pixelFormat.flags & DDPF_FOURCC))
+        return false;
+    if (header.pixelFormat.fourCC == DDS_FOURCC_DXT1)
+        image.format = DdsFormat::BC1;
+    else if (header.pixelFormat.fourCC == DDS_FOURCC_DXT5)
+        image.format = DdsFormat::BC3;
+    else
+        return false;
+
+    image.width = header.width;
+    image.height = header.height;
+    image.levels.clear();
+    uint32_t levelCount = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+    size_t offset = 4 + sizeof(DdsHeader);
+    uint32_t width = header.width, height = header.height;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        DdsLevel l;
+        l.width = width;
+        l.height = height;
+        l.offset = offset;
+        l.size = DdsLevelSize(image.format, width, height);
+        if (offset + l.size > size)
+            return false;
+        image.levels.push_back(l);
+        offset += l.size;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return true;
+}
+
+// where the cooked version of an image lives: next to it, with the extension replaced
+inline std::string DdsPathFor(const std::string &imagePath)
+{
+    size_t dot = imagePath.find_last_of('.');
+    size_t slash = imagePath.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return imagePath + ".dds";
+    return imagePath.substr(0, dot) + ".dds";
+}
+#endif
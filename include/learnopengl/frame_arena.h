@@ -0,0 +1,91 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Bump allocator for data that lives for one frame. Allocate() hands out aligned pieces of one block and
+// Reset() takes them all back at once, nothing is freed one by one. When a frame needs more than the block
+// holds, further blocks are chained on; the next Reset() replaces them with a single block big enough for
+// that frame, so after the first few frames recording never reaches the heap.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t initialBytes = 64 * 1024)
+    {
+        blocks.emplace_back(initialBytes);
+    }
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        Block *block = &blocks.back();
+        size_t offset = align(block->used, alignment);
+        if (offset + bytes > block->size)
+        {
+            blocks.emplace_back(std::max(bytes + alignment, block->size * 2));
+            growths++;
+            block = &blocks.back();
+            offset = align(block->used, alignment);
+        }
+        block->used = offset + bytes;
+        used += bytes;
+        highWater = std::max(highWater, used);
+        return block->data.get() + offset;
+    }
+
+    // uninitialized storage for count Ts; only for trivially destructible types, nothing runs their destructors
+    template <typename T>
+    T *Allocate(size_t count)
+    {
+        return static_cast<T *>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void Reset()
+    {
+        if (blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (const Block &block : blocks)
+                total += block.size;
+            blocks.clear();
+            blocks.emplace_back(total);
+        }
+        blocks.back().used = 0;
+        used = 0;
+    }
+
+    size_t Capacity() const
+    {
+        size_t total = 0;
+        for (const Block &block : blocks)
+            total += block.size;
+        return total;
+    }
+    size_t HighWater() const { return highWater; }
+    // how many times a frame outgrew the arena, each one a heap allocation
+    unsigned int Growths() const { return growths; }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+        size_t used = 0;
+
+        explicit Block(size_t size) : data(new unsigned char[size]), size(size) {}
+    };
+    std::vector<Block> blocks;
+    size_t used = 0, highWater = 0;
+    unsigned int growths = 0;
+
+    static size_t align(size_t offset, size_t alignment)
+    {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+};
+#endif
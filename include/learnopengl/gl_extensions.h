@@ -0,0 +1,134 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad in libs/ was generated for the 3.3 core profile, but the window asks for a 4.6 context. The few newer
+// entry points the renderer uses are fetched here, right after gladLoadGLLoader(), with the same loader.
+// A pointer stays null when the driver doesn't have the function; callers check it and fall back. GLX hands out
+// an address for any gl* name, so where it matters the pointer is only fetched when the context version or an
+// extension says the function is really there.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+#define GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT 0x90DF
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+struct GLExtensions {
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length,
+                                                  GLenum *binaryFormat, void *binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary,
+                                               GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect,
+                                                            GLsizei drawcount, GLsizei stride);
+    typedef void (APIENTRYP CopyImageSubDataProc)(GLuint srcName, GLenum srcTarget, GLint srcLevel, GLint srcX,
+                                                  GLint srcY, GLint srcZ, GLuint dstName, GLenum dstTarget,
+                                                  GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ,
+                                                  GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth);
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+    typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+    typedef void (APIENTRYP DispatchComputeProc)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+    typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+
+    // GL_KHR_parallel_shader_compile (or the ARB version): programs compile on driver threads and
+    // GL_COMPLETION_STATUS_KHR can be queried without blocking
+    bool parallelShaderCompile = false;
+    MaxShaderCompilerThreadsProc MaxShaderCompilerThreads = nullptr;
+    // GL 4.1
+    GetProgramBinaryProc GetProgramBinary = nullptr;
+    ProgramBinaryProc ProgramBinary = nullptr;
+    ProgramParameteriProc ProgramParameteri = nullptr;
+    // GL 4.2
+    MemoryBarrierProc MemoryBarrier = nullptr;
+    // GL 4.3, or GL_ARB_compute_shader together with GL_ARB_shader_storage_buffer_object
+    bool computeShaders = false;
+    DispatchComputeProc DispatchCompute = nullptr;
+    MultiDrawElementsIndirectProc MultiDrawElementsIndirect = nullptr;
+    CopyImageSubDataProc CopyImageSubData = nullptr;
+    // GL 4.4
+    BufferStorageProc BufferStorage = nullptr;
+
+    // of the current context, from GL_MAJOR_VERSION/GL_MINOR_VERSION
+    GLint majorVersion = 0, minorVersion = 0;
+
+    static GLExtensions &Get()
+    {
+        static GLExtensions extensions;
+        return extensions;
+    }
+
+    void Load(GLADloadproc load)
+    {
+        glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+        glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+        if (AtLeast(4, 1) || HasExtension("GL_ARB_get_program_binary"))
+        {
+            GetProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+            ProgramBinary = (ProgramBinaryProc)load("glProgramBinary");
+            ProgramParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+        }
+        if (AtLeast(4, 2) || HasExtension("GL_ARB_shader_image_load_store"))
+            MemoryBarrier = (MemoryBarrierProc)load("glMemoryBarrier");
+        computeShaders = AtLeast(4, 3) ||
+                         (HasExtension("GL_ARB_compute_shader") && HasExtension("GL_ARB_shader_storage_buffer_object"));
+        if (computeShaders)
+            DispatchCompute = (DispatchComputeProc)load("glDispatchCompute");
+        if (AtLeast(4, 3) || HasExtension("GL_ARB_multi_draw_indirect"))
+            MultiDrawElementsIndirect = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+        if (AtLeast(4, 3) || HasExtension("GL_ARB_copy_image"))
+            CopyImageSubData = (CopyImageSubDataProc)load("glCopyImageSubData");
+        if (AtLeast(4, 4) || HasExtension("GL_ARB_buffer_storage"))
+            BufferStorage = (BufferStorageProc)load("glBufferStorage");
+        if (HasExtension("GL_KHR_parallel_shader_compile"))
+            MaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+        else if (HasExtension("GL_ARB_parallel_shader_compile"))
+            MaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+        parallelShaderCompile = MaxShaderCompilerThreads != nullptr;
+    }
+
+    bool AtLeast(GLint major, GLint minor) const
+    {
+        return majorVersion > major || (majorVersion == major && minorVersion >= minor);
+    }
+
+    // the function pointers alone don't tell, GLX hands out addresses for any gl* name
+    static bool HasExtension(const char *name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+#endif
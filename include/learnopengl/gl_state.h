@@ -0,0 +1,219 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/render_stats.h>
+
+// Shadow copy of the GL state the renderer changes often: program, vertex array, framebuffers, the 2D and
+// 2D array texture of each unit, the depth/blend/cull/stencil switches, the depth and blend functions and the
+// culled face.
+// A call that would set what is already set is dropped. The renderer's code goes through here for all of
+// these, the state starts out unknown and Invalidate() makes it unknown again after foreign code (ImGui) ran.
+// With filtering off every call reaches the driver, so the two can be compared; both modes are counted.
+class GLState
+{
+public:
+    static const int TEXTURE_UNITS = 16;
+
+    bool filtering = true;
+
+    static GLState &Get()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void Invalidate()
+    {
+        program = vertexArray = readFramebuffer = drawFramebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int unit = 0; unit < TEXTURE_UNITS; unit++)
+            textures[unit][0] = textures[unit][1] = UNKNOWN;
+        for (int &cap : caps)
+            cap = -1;
+        depthFunc = blendSrc = blendDst = cullFace = UNKNOWN;
+        depthMask = -1;
+    }
+
+    void UseProgram(GLuint id)
+    {
+        if (!change(program, id))
+            return;
+        glUseProgram(id);
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (!change(vertexArray, id))
+            return;
+        glBindVertexArray(id);
+        RenderStats::Frame().vertexArrayBinds++;
+    }
+
+    void BindFramebuffer(GLenum target, GLuint id)
+    {
+        if (target == GL_FRAMEBUFFER)
+        {
+            bool same = readFramebuffer == id && drawFramebuffer == id;
+            if (!change(same))
+                return;
+            readFramebuffer = drawFramebuffer = id;
+        }
+        else if (!change(target == GL_READ_FRAMEBUFFER ? readFramebuffer : drawFramebuffer, id))
+            return;
+        glBindFramebuffer(target, id);
+    }
+
+    void ActiveTexture(GLenum unit)
+    {
+        if (!change(activeUnit, unit))
+            return;
+        glActiveTexture(unit);
+    }
+
+    // binds to the active unit
+    void BindTexture(GLenum target, GLuint id)
+    {
+        unsigned int *slot = activeUnit == UNKNOWN ? nullptr : textureSlot(activeUnit - GL_TEXTURE0, target);
+        if (slot ? !change(*slot, id) : !change(false))
+            return;
+        // it went to a unit that isn't known, any of them may hold it now
+        if (activeUnit == UNKNOWN)
+            for (int unit = 0; unit < TEXTURE_UNITS; unit++)
+                if (unsigned int *other = textureSlot(unit, target))
+                    *other = UNKNOWN;
+        glBindTexture(target, id);
+        RenderStats::Frame().textureBinds++;
+    }
+
+    // binds to the given unit, selecting it only when the bind isn't dropped
+    void BindTextureUnit(unsigned int unit, GLenum target, GLuint id)
+    {
+        unsigned int *slot = textureSlot(unit, target);
+        if (slot && filtering && *slot == id)
+        {
+            RenderStats::Frame().stateCallsFiltered++;
+            RenderStats::Frame().textureBindsSkipped++;
+            return;
+        }
+        ActiveTexture(GL_TEXTURE0 + unit);
+        BindTexture(target, id);
+    }
+
+    void Enable(GLenum cap) { setCap(cap, true); }
+    void Disable(GLenum cap) { setCap(cap, false); }
+
+    void DepthFunc(GLenum func)
+    {
+        if (!change(depthFunc, func))
+            return;
+        glDepthFunc(func);
+    }
+
+    void DepthMask(GLboolean write)
+    {
+        if (!change(depthMask == write))
+            return;
+        depthMask = write;
+        glDepthMask(write);
+    }
+
+    void BlendFunc(GLenum src, GLenum dst)
+    {
+        if (!change(blendSrc == src && blendDst == dst))
+            return;
+        blendSrc = src;
+        blendDst = dst;
+        glBlendFunc(src, dst);
+    }
+
+    void CullFace(GLenum face)
+    {
+        if (!change(cullFace, face))
+            return;
+        glCullFace(face);
+    }
+
+    // deleted names can come back from glGen*/glCreate*, they must not look bound
+    void DeleteTextures(GLsizei count, const GLuint *ids)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            for (int unit = 0; unit < TEXTURE_UNITS; unit++)
+                for (unsigned int &bound : textures[unit])
+                    if (bound == ids[i])
+                        bound = UNKNOWN;
+        glDeleteTextures(count, ids);
+    }
+
+    void DeleteProgram(GLuint id)
+    {
+        if (program == id)
+            program = UNKNOWN;
+        glDeleteProgram(id);
+        programsDeleted++;
+    }
+
+    // changes whenever a program is deleted, after which GL may hand its name out to a new one
+    unsigned int ProgramGeneration() const { return programsDeleted; }
+
+private:
+    static const unsigned int UNKNOWN = ~0u;
+    enum { CAP_DEPTH_TEST, CAP_BLEND, CAP_CULL_FACE, CAP_STENCIL_TEST, CAP_COUNT };
+
+    unsigned int program, vertexArray, readFramebuffer, drawFramebuffer;
+    unsigned int programsDeleted = 0;
+    unsigned int activeUnit;
+    unsigned int textures[TEXTURE_UNITS][2];   // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY
+    int caps[CAP_COUNT];                       // -1 unknown, 0 disabled, 1 enabled
+    unsigned int depthFunc, blendSrc, blendDst, cullFace;
+    int depthMask;
+
+    GLState() { Invalidate(); }
+
+    // counts the call and says whether it has to reach GL
+    bool change(bool same)
+    {
+        if (filtering && same)
+        {
+            RenderStats::Frame().stateCallsFiltered++;
+            return false;
+        }
+        RenderStats::Frame().stateCalls++;
+        return true;
+    }
+
+    bool change(unsigned int &current, unsigned int value)
+    {
+        if (!change(current == value))
+            return false;
+        current = value;
+        return true;
+    }
+
+    unsigned int *textureSlot(unsigned int unit, GLenum target)
+    {
+        if (unit >= TEXTURE_UNITS)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &textures[unit][0];
+        if (target == GL_TEXTURE_2D_ARRAY)
+            return &textures[unit][1];
+        return nullptr;
+    }
+
+    void setCap(GLenum cap, bool enable)
+    {
+        int index = cap == GL_DEPTH_TEST ? CAP_DEPTH_TEST : cap == GL_BLEND ? CAP_BLEND :
+                    cap == GL_CULL_FACE ? CAP_CULL_FACE : cap == GL_STENCIL_TEST ? CAP_STENCIL_TEST : -1;
+        if (index < 0 ? !change(false) : !change(caps[index] == (int)enable))
+            return;
+        if (index >= 0)
+            caps[index] = enable;
+        if (enable)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+};
+#endif
@@ -0,0 +1,98 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+// A GL query of one target around a stretch of commands. The results arrive a few frames late, so it cycles
+// through a small ring of queries and only reads the ones that are available; a frame whose query slot is
+// still busy simply isn't measured. Average() is a running average of the results.
+class GpuQuery
+{
+public:
+    static const int QUERY_COUNT = 4;
+
+    explicit GpuQuery(GLenum target) : target(target) {}
+    GpuQuery(const GpuQuery &) = delete;
+    GpuQuery &operator=(const GpuQuery &) = delete;
+
+    void Begin()
+    {
+        if (!queries[0])
+            glGenQueries(QUERY_COUNT, queries);
+        collect();
+        active = !issued[next];
+        if (active)
+            glBeginQuery(target, queries[next]);
+    }
+
+    void End()
+    {
+        if (!active)
+            return;
+        glEndQuery(target);
+        issued[next] = true;
+        next = (next + 1) % QUERY_COUNT;
+        active = false;
+    }
+
+    double Average() const { return average; }
+    unsigned int Samples() const { return samples; }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        if (queries[0])
+            glDeleteQueries(QUERY_COUNT, queries);
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            queries[i] = 0;
+            issued[i] = false;
+        }
+    }
+
+private:
+    GLenum target;
+    unsigned int queries[QUERY_COUNT] = {};
+    bool issued[QUERY_COUNT] = {};
+    int next = 0;
+    bool active = false;
+    double average = 0.0;
+    unsigned int samples = 0;
+
+    void collect()
+    {
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            if (!issued[i])
+                continue;
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 result = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &result);
+            issued[i] = false;
+            average = samples == 0 ? result : average * 0.95 + result * 0.05;
+            samples++;
+        }
+    }
+};
+
+// GPU time, measured with GL_TIME_ELAPSED queries
+class GpuTimer : public GpuQuery
+{
+public:
+    GpuTimer() : GpuQuery(GL_TIME_ELAPSED) {}
+
+    double Ms() const { return Average() / 1000000.0; }
+};
+
+// fragments that passed the depth and stencil tests, measured with GL_SAMPLES_PASSED queries
+class GpuFragmentCounter : public GpuQuery
+{
+public:
+    GpuFragmentCounter() : GpuQuery(GL_SAMPLES_PASSED) {}
+
+    double Fragments() const { return Average(); }
+};
+#endif
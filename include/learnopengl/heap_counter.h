@@ -0,0 +1,48 @@
+#ifndef HEAP_COUNTER_H
+#define HEAP_COUNTER_H
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations made through operator new (any thread) and through ImGui's allocator, so the
+// render loop can tell how many a frame made. The counting operator new/delete replace the library ones in
+// the one translation unit that defines HEAP_COUNTER_IMPLEMENTATION before including this header.
+struct HeapCounter {
+    static std::atomic<unsigned long> &allocations()
+    {
+        static std::atomic<unsigned long> count(0);
+        return count;
+    }
+
+    static unsigned long Allocations() { return allocations().load(std::memory_order_relaxed); }
+
+    static void *ImGuiAlloc(size_t size, void *)
+    {
+        allocations().fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size);
+    }
+    static void ImGuiFree(void *ptr, void *) { std::free(ptr); }
+};
+
+#ifdef HEAP_COUNTER_IMPLEMENTATION
+void *operator new(size_t size)
+{
+    HeapCounter::allocations().fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    HeapCounter::allocations().fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept { return operator new(size, tag); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+#endif
+#endif
@@ -0,0 +1,227 @@
+#ifndef LIGHT_BUFFER_H
+#define LIGHT_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/render_stats.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// std430 mirrors of the light structs in 8.1.deferred_shading.fs. A vec3 there is aligned to 16 bytes, so each
+// one is followed by a scalar that fills its fourth component, and the structs are padded to a multiple of 16.
+struct GpuPointLight {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 color;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float radius;
+    glm::vec3 specular;
+    float padding;
+};
+static_assert(sizeof(GpuPointLight) == 80, "GpuPointLight has to match the std430 layout of pointLight");
+
+struct GpuSpotLight {
+    glm::vec3 position;
+    float cutOff;
+    glm::vec3 direction;
+    float outerCutOff;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+    float radius;
+    int shadow;   // its tile in the shadow atlas's buffer, -1 for none
+    float padding[2];
+};
+static_assert(sizeof(GpuSpotLight) == 96, "GpuSpotLight has to match the std430 layout of SpotLight");
+
+// Where a light stops counting: the distance at which its brightest term, divided by the attenuation
+// constant + linear d + quadratic d^2, falls to cutoff. The shaders fade the attenuation to zero there, so a
+// light can be left out wherever its sphere doesn't reach without a visible edge.
+inline float LightRadius(float constant, float linear, float quadratic, const glm::vec3 &brightness, float cutoff)
+{
+    float limit = std::max(std::max(brightness.r, brightness.g), brightness.b) / cutoff;
+    if (quadratic > 0.0f)
+        return (-linear + std::sqrt(std::max(linear * linear - 4.0f * quadratic * (constant - limit), 0.0f))) /
+               (2.0f * quadratic);
+    if (linear > 0.0f)
+        return std::max((limit - constant) / linear, 0.0f);
+    return 1e30f;
+}
+
+// A shader storage buffer of lights that keeps a CPU copy of what the GPU has. Set() only marks the lights whose
+// bytes changed, and Upload() writes the one range that covers them. With glBufferStorage the buffer stays mapped
+// for its whole life and holds a region per frame in flight, like UniformRing: an upload moves to the next region,
+// waits for the fence placed after the last lighting pass that read it, and writes the lights that changed since
+// that region was last written, so the GPU never reads a region being written. Without 4.4 it is one region and
+// glBufferSubData. SetCount() limits the lights the shaders loop over to the first ones, the visible lights
+// compacted to the front.
+template<typename T>
+class LightBuffer
+{
+public:
+    static const unsigned int SLOTS = 3;
+
+    LightBuffer() = default;
+    LightBuffer(const LightBuffer &) = delete;
+    LightBuffer &operator=(const LightBuffer &) = delete;
+
+    void Create(const std::string &name, unsigned int count)
+    {
+        lights.assign(count, T());
+        active = count;
+        GLint alignment = 256;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        GLsizeiptr bytes = std::max<GLsizeiptr>(count * sizeof(T), sizeof(T));
+        stride = (bytes + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        if (GLExtensions::Get().BufferStorage)
+        {
+            GLExtensions::Get().BufferStorage(GL_SHADER_STORAGE_BUFFER, stride * SLOTS, nullptr,
+                                              GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+            mapped = (char *)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, stride * SLOTS,
+                                              GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+            if (!mapped)
+            {
+                // immutable storage can't be respecified, start over with a mutable buffer
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            }
+        }
+        if (!mapped)
+            glBufferData(GL_SHADER_STORAGE_BUFFER, stride, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        slots = mapped ? SLOTS : 1;
+        slot = slots - 1;
+        // every region starts out unwritten
+        for (unsigned int i = 0; i < SLOTS; i++)
+        {
+            dirtyFirst[i] = 0;
+            dirtyEnd[i] = count;
+        }
+        changed = count > 0;
+        std::cout << "LIGHTS::BUFFER " << name << ": " << count << " lights, " << count * sizeof(T) << " bytes, ";
+        if (mapped)
+            std::cout << "persistently mapped, " << SLOTS << " regions" << std::endl;
+        else
+            std::cout << "glBufferSubData" << std::endl;
+    }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        for (GLsync &fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        if (mapped)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+        mapped = nullptr;
+        buffer = 0;
+    }
+
+    void Set(unsigned int index, const T &light)
+    {
+        if (memcmp(&lights[index], &light, sizeof(T)) == 0)
+            return;
+        lights[index] = light;
+        for (unsigned int i = 0; i < SLOTS; i++)
+        {
+            dirtyFirst[i] = std::min(dirtyFirst[i], index);
+            dirtyEnd[i] = std::max(dirtyEnd[i], index + 1);
+        }
+        changed = true;
+    }
+
+    // writes the lights that changed into the next region, returns the bytes that went to the GPU; when nothing
+    // changed the current region stays bound
+    size_t Upload()
+    {
+        if (!changed)
+            return 0;
+        changed = false;
+        slot = (slot + 1) % slots;
+        unsigned int first = dirtyFirst[slot], end = dirtyEnd[slot];
+        dirtyFirst[slot] = ~0u;
+        dirtyEnd[slot] = 0;
+        if (first >= end)
+            return 0;
+        GLintptr offset = slot * stride + first * sizeof(T);
+        GLsizeiptr length = (end - first) * sizeof(T);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        if (mapped)
+        {
+            if (fences[slot])
+            {
+                auto start = std::chrono::steady_clock::now();
+                glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                RenderStats::Frame().fenceWaitMs +=
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                glDeleteSync(fences[slot]);
+                fences[slot] = 0;
+            }
+            memcpy(mapped + offset, &lights[first], length);
+            glFlushMappedBufferRange(GL_SHADER_STORAGE_BUFFER, offset, length);
+        }
+        else
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, length, &lights[first]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return length;
+    }
+
+    // the region the last Upload() wrote
+    void Bind(unsigned int binding) const
+    {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, slot * stride, stride);
+    }
+
+    // after the draw that reads the lights, so an Upload() into the same region knows when the GPU is done with it
+    void Fence()
+    {
+        if (!mapped)
+            return;
+        if (fences[slot])
+            glDeleteSync(fences[slot]);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void SetCount(unsigned int count) { active = std::min<unsigned int>(count, lights.size()); }
+    unsigned int Count() const { return active; }
+    unsigned int Capacity() const { return lights.size(); }
+
+private:
+    std::vector<T> lights;
+    unsigned int buffer = 0;
+    GLsizeiptr stride = 0;
+    char *mapped = nullptr;
+    GLsync fences[SLOTS] = {};
+    unsigned int slots = 1, slot = 0;
+    // per region, the lights changed since it was last written
+    unsigned int dirtyFirst[SLOTS] = {~0u, ~0u, ~0u}, dirtyEnd[SLOTS] = {};
+    bool changed = false;
+    unsigned int active = 0;
+};
+#endif
@@ -0,0 +1,103 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/gpu_timer.h>
+#include <learnopengl/shader.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The view frustum cut into CLUSTERS_X x CLUSTERS_Y screen tiles and CLUSTERS_Z depth slices, spaced
+// exponentially between the near and far plane. Cull() runs light_culling.comp, which lists the lights whose
+// sphere (the radius LightRadius() gave them) touches a cluster; the clustered lighting pass then only loops
+// over the list of the cluster its pixel is in.
+// Both shaders take the grid from Defines(), the lists are shader storage buffers at bindings 3 and 4.
+class LightClusters
+{
+public:
+    static const unsigned int CLUSTERS_X = 16, CLUSTERS_Y = 9, CLUSTERS_Z = 24;
+    static const unsigned int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+    // every light of the scene fits in one cluster, so a list never overflows
+    static const unsigned int MAX_LIGHTS_PER_CLUSTER = 128;
+    static const unsigned int COUNTS_BINDING = 3, INDICES_BINDING = 4;
+    // invocations per work group in light_culling.comp, one per cluster
+    static const unsigned int GROUP_SIZE = 64;
+
+    LightClusters() = default;
+    LightClusters(const LightClusters &) = delete;
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    static std::vector<std::string> Defines()
+    {
+        return {"CLUSTERS_X " + std::to_string(CLUSTERS_X), "CLUSTERS_Y " + std::to_string(CLUSTERS_Y),
+                "CLUSTERS_Z " + std::to_string(CLUSTERS_Z),
+                "MAX_LIGHTS_PER_CLUSTER " + std::to_string(MAX_LIGHTS_PER_CLUSTER),
+                "CLUSTER_GROUP_SIZE " + std::to_string(GROUP_SIZE)};
+    }
+
+    void Create()
+    {
+        glGenBuffers(1, &counts);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counts);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &indices);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, indices);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint), nullptr,
+                     GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        std::cout << "LIGHTS::CLUSTERS " << CLUSTERS_X << "x" << CLUSTERS_Y << "x" << CLUSTERS_Z << ", "
+                  << CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(GLuint) / 1024 << " KB of light lists"
+                  << std::endl;
+    }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        if (counts)
+            glDeleteBuffers(1, &counts);
+        if (indices)
+            glDeleteBuffers(1, &indices);
+        counts = indices = 0;
+        timer.Release();
+    }
+
+    // rebuilds the light lists from the first count lights of each buffer, with the light buffers bound;
+    // the lighting pass after it reads them
+    void Cull(Shader &culling, const glm::mat4 &projection, float nearPlane, float farPlane, int sipkeCount,
+              int ramoviCount, int spotCount)
+    {
+        timer.Begin();
+        culling.use();
+        culling.setMat4("inverseProjection", glm::inverse(projection));
+        culling.setFloat("zNear", nearPlane);
+        culling.setFloat("zFar", farPlane);
+        culling.setInt("sipkeLightCount", sipkeCount);
+        culling.setInt("ramoviLightCount", ramoviCount);
+        culling.setInt("spotLightCount", spotCount);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTS_BINDING, counts);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDICES_BINDING, indices);
+        GLExtensions::Get().DispatchCompute((CLUSTER_COUNT + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+        GLExtensions::Get().MemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        timer.End();
+    }
+
+    // compute shaders and storage buffers are core in 4.3, the context asks for 4.6 but the driver may still say no;
+    // decided from the version and extensions in GLExtensions::Load(), a non-null pointer alone proves nothing
+    static bool Supported()
+    {
+        const GLExtensions &gl = GLExtensions::Get();
+        return gl.computeShaders && gl.DispatchCompute && gl.MemoryBarrier;
+    }
+
+    GpuTimer &Timer() { return timer; }
+
+private:
+    unsigned int counts = 0, indices = 0;
+    GpuTimer timer;
+};
+#endif
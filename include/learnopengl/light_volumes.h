@@ -0,0 +1,199 @@
+#ifndef LIGHT_VOLUMES_H
+#define LIGHT_VOLUMES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/gpu_timer.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/shader.h>
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Deferred lighting by volume instead of over the whole screen: every point light is a low-poly sphere of its
+// radius and every spot light a cone of its outer angle, instanced per light set straight from the light
+// buffers (light_volume.vs). Per set the volumes first mark the stencil buffer the z-fail way: a back face
+// behind the scene surface adds one, a front face behind it takes one away, so a pixel ends up with the number
+// of volumes its surface is inside, also when the camera is inside one. Then the back faces are drawn with
+// additive blending where the stencil isn't zero and the surface is in front of the face.
+// The bound framebuffer has to have the scene's depth and a stencil buffer.
+class LightVolumes
+{
+public:
+    enum LightSet { SET_SIPKE = 0, SET_RAMOVI, SET_SPOT, SET_COUNT };
+    static const int SPHERE_STACKS = 8, SPHERE_SLICES = 12, CONE_SLICES = 12;
+
+    LightVolumes() = default;
+    LightVolumes(const LightVolumes &) = delete;
+    LightVolumes &operator=(const LightVolumes &) = delete;
+
+    void Create()
+    {
+        const float PI = 3.14159265f;
+        std::vector<glm::vec3> vertices;
+        std::vector<unsigned short> indices;
+
+        // the faces lie inside the sphere they approximate, pushed out until they enclose it
+        float sphereScale = 1.0f / (std::cos(PI / (2 * SPHERE_STACKS)) * std::cos(PI / SPHERE_SLICES));
+        for (int stack = 0; stack <= SPHERE_STACKS; stack++)
+        {
+            float phi = PI * stack / SPHERE_STACKS;
+            for (int slice = 0; slice < SPHERE_SLICES; slice++)
+            {
+                float theta = 2.0f * PI * slice / SPHERE_SLICES;
+                vertices.push_back(sphereScale * glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi),
+                                                           std::sin(phi) * std::sin(theta)));
+            }
+        }
+        for (int stack = 0; stack < SPHERE_STACKS; stack++)
+            for (int slice = 0; slice < SPHERE_SLICES; slice++)
+            {
+                unsigned short a = stack * SPHERE_SLICES + slice;
+                unsigned short b = stack * SPHERE_SLICES + (slice + 1) % SPHERE_SLICES;
+                unsigned short c = a + SPHERE_SLICES, d = b + SPHERE_SLICES;
+                if (stack > 0)
+                    triangle(vertices, indices, glm::vec3(0.0f), a, b, c);
+                if (stack < SPHERE_STACKS - 1)
+                    triangle(vertices, indices, glm::vec3(0.0f), b, d, c);
+            }
+        sphere = upload(vertices, indices);
+
+        // apex at the origin, opening along +z to a base of radius 1 at z = 1
+        vertices.clear();
+        indices.clear();
+        float coneScale = 1.0f / std::cos(PI / CONE_SLICES);
+        vertices.push_back(glm::vec3(0.0f));
+        vertices.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+        for (int slice = 0; slice < CONE_SLICES; slice++)
+        {
+            float theta = 2.0f * PI * slice / CONE_SLICES;
+            vertices.push_back(glm::vec3(coneScale * std::cos(theta), coneScale * std::sin(theta), 1.0f));
+        }
+        glm::vec3 inside(0.0f, 0.0f, 0.75f);
+        for (int slice = 0; slice < CONE_SLICES; slice++)
+        {
+            unsigned short a = 2 + slice, b = 2 + (slice + 1) % CONE_SLICES;
+            triangle(vertices, indices, inside, 0, a, b);
+            triangle(vertices, indices, inside, 1, a, b);
+        }
+        cone = upload(vertices, indices);
+        std::cout << "LIGHTS::VOLUMES sphere " << sphere.indexCount / 3 << " triangles, cone " << cone.indexCount / 3
+                  << " triangles" << std::endl;
+    }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        for (VolumeMesh *mesh : {&sphere, &cone})
+        {
+            if (mesh->vertexArray)
+                glDeleteVertexArrays(1, &mesh->vertexArray);
+            if (mesh->buffers[0])
+                glDeleteBuffers(2, mesh->buffers);
+            *mesh = VolumeMesh();
+        }
+        for (GpuFragmentCounter &counter : counters)
+            counter.Release();
+    }
+
+    // lights the first count lights of each buffer, with the light buffers and the g-buffer textures bound
+    void Draw(Shader &shader, unsigned int sipkeCount, unsigned int ramoviCount, unsigned int spotCount)
+    {
+        GLState &state = GLState::Get();
+        shader.use();
+        state.Enable(GL_DEPTH_TEST);
+        state.DepthMask(GL_FALSE);
+        state.Enable(GL_STENCIL_TEST);
+        // volumes that reach past the far plane still have to be counted
+        state.Enable(GL_DEPTH_CLAMP);
+        state.Enable(GL_BLEND);
+        state.BlendFunc(GL_ONE, GL_ONE);
+        unsigned int counts[SET_COUNT] = {sipkeCount, ramoviCount, spotCount};
+        for (int set = 0; set < SET_COUNT; set++)
+        {
+            if (!counts[set])
+                continue;
+            const VolumeMesh &mesh = set == SET_SPOT ? cone : sphere;
+            shader.setInt("lightSet", set);
+
+            // mark: both faces, no color
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            state.Disable(GL_CULL_FACE);
+            state.DepthFunc(GL_LESS);
+            glStencilFunc(GL_ALWAYS, 0, 0xFF);
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            drawInstanced(mesh, counts[set]);
+
+            // shade: back faces, only where some volume holds the surface
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            state.Enable(GL_CULL_FACE);
+            state.CullFace(GL_FRONT);
+            state.DepthFunc(GL_GEQUAL);
+            glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+            counters[set].Begin();
+            drawInstanced(mesh, counts[set]);
+            counters[set].End();
+        }
+        state.CullFace(GL_BACK);
+        state.DepthFunc(GL_LESS);
+        state.Disable(GL_BLEND);
+        state.Disable(GL_DEPTH_CLAMP);
+        state.Disable(GL_STENCIL_TEST);
+        state.DepthMask(GL_TRUE);
+    }
+
+    // fragments the lights of a set shaded, averaged over the last frames
+    double Fragments(LightSet set) const { return counters[set].Fragments(); }
+
+private:
+    struct VolumeMesh {
+        unsigned int vertexArray = 0;
+        unsigned int buffers[2] = {};
+        unsigned int indexCount = 0;
+    };
+
+    VolumeMesh sphere, cone;
+    GpuFragmentCounter counters[SET_COUNT];
+
+    // adds the triangle wound counterclockwise as seen from outside, which is the side away from inside
+    static void triangle(const std::vector<glm::vec3> &vertices, std::vector<unsigned short> &indices,
+                         const glm::vec3 &inside, unsigned short a, unsigned short b, unsigned short c)
+    {
+        glm::vec3 normal = glm::cross(vertices[b] - vertices[a], vertices[c] - vertices[a]);
+        bool outward = glm::dot(normal, vertices[a] + vertices[b] + vertices[c] - 3.0f * inside) > 0.0f;
+        indices.push_back(a);
+        indices.push_back(outward ? b : c);
+        indices.push_back(outward ? c : b);
+    }
+
+    static VolumeMesh upload(const std::vector<glm::vec3> &vertices, const std::vector<unsigned short> &indices)
+    {
+        VolumeMesh mesh;
+        mesh.indexCount = indices.size();
+        glGenVertexArrays(1, &mesh.vertexArray);
+        glGenBuffers(2, mesh.buffers);
+        GLState::Get().BindVertexArray(mesh.vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.buffers[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+        GLState::Get().BindVertexArray(0);
+        return mesh;
+    }
+
+    static void drawInstanced(const VolumeMesh &mesh, unsigned int count)
+    {
+        GLState::Get().BindVertexArray(mesh.vertexArray);
+        glDrawElementsInstanced(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_SHORT, 0, count);
+        RenderStats::Frame().drawCalls++;
+    }
+};
+#endif
@@ -0,0 +1,316 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/hash.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// On-disk layout of a lightmap file, written by tools/lightmap_baker.cpp (offsets in bytes from the start):
+//
+//   LightmapHeader
+//   LightmapMesh[meshCount]
+//   LightmapLight lights[lightCount]       the lights it was baked with
+//   LightmapVertex vertices[]              (at vertexDataOffset, every mesh's vertices back to back)
+//   unsigned int indices[]                 (at indexDataOffset, every mesh's indices back to back)
+//   uint16_t texels[width * height * 4]    (at texelDataOffset, RGBA half floats, bottom row first)
+//
+// The texels hold the ambient plus diffuse light of the static lights without the albedo, alpha is 1 where
+// the surface is baked. The baker cuts the meshes into charts, so a mesh gets more vertices than it was loaded
+// with: each lightmap vertex names the loaded vertex it copies and adds its lightmap UV, and the indices are
+// replaced as a whole. A mesh is only taken over when the geometry the program loaded hashes the same as the
+// geometry that was baked.
+const uint32_t LIGHTMAP_MAGIC = 0x50414d4c;        // "LMAP"
+const uint32_t LIGHTMAP_VERSION = 1;
+const uint32_t LIGHTMAP_LIGHTS_MAGIC = 0x5448474c; // "LGHT"
+
+enum LightmapLightType : uint32_t { LIGHTMAP_POINT = 0, LIGHTMAP_SPOT = 1 };
+
+// a static light, everything the ambient and diffuse part the lighting pass computes for it depends on
+struct LightmapLight {
+    uint32_t type;
+    glm::vec3 position;
+    glm::vec3 direction;        // spot lights only
+    glm::vec3 ambient;
+    glm::vec3 diffuse;          // with a point light's color multiplied in
+    float constant, linear, quadratic;
+    float radius;               // LightRadius(), where the attenuation is faded out
+    float cutOff, outerCutOff;  // cosines, spot lights only
+};
+static_assert(sizeof(LightmapLight) == 76, "LightmapLight is written to disk as it is");
+
+struct LightmapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t meshCount;
+    uint32_t lightCount;
+    uint64_t lightsHash;        // HashLights() of the lights below
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+    uint64_t texelDataOffset;
+    double bakeMs;              // time the baker spent on the lights, cached ones included
+};
+
+struct LightmapMesh {
+    uint64_t geometryHash;      // HashMeshGeometry() of the mesh as the program loads it
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t firstVertex;
+    uint32_t firstIndex;
+};
+
+struct LightmapVertex {
+    uint32_t source;            // the loaded vertex it copies
+    glm::vec2 coords;
+};
+
+inline uint64_t HashMeshGeometry(const Vertex *vertices, size_t vertexCount, const unsigned int *indices,
+                                 size_t indexCount)
+{
+    uint64_t hash = HashBytes(vertices, vertexCount * sizeof(Vertex));
+    return HashBytes(indices, indexCount * sizeof(unsigned int), hash);
+}
+inline uint64_t HashMeshGeometry(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    return HashMeshGeometry(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
+inline uint64_t HashLights(const std::vector<LightmapLight> &lights)
+{
+    return HashBytes(lights.data(), lights.size() * sizeof(LightmapLight));
+}
+
+// IEEE half, rounded to nearest; what is too large for a half becomes infinity, too small zero
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    if (exponent <= 0)
+        return sign;
+    uint16_t half = sign | (uint16_t)(exponent << 10) | (uint16_t)(mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++;   // carries into the exponent when the mantissa overflows, which is still right
+    return half;
+}
+
+// A baked lightmap as the program uses it: the lightmap vertices for the meshes it was baked for, and the
+// texels as a GL_RGBA16F texture. The static light list the baker works from is written by the program too.
+class Lightmap
+{
+public:
+    struct Bake {
+        uint32_t width = 0, height = 0;
+        std::vector<LightmapMesh> meshes;
+        std::vector<LightmapLight> lights;
+        std::vector<LightmapVertex> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<uint16_t> texels;
+        double bakeMs = 0.0;
+    };
+
+    static std::string PathFor(const std::string &modelPath)
+    {
+        return modelPath + ".lightmap";
+    }
+    static std::string LightsPathFor(const std::string &modelPath)
+    {
+        return modelPath + ".lights";
+    }
+
+    Lightmap() = default;
+    Lightmap(const Lightmap &) = delete;
+    Lightmap &operator=(const Lightmap &) = delete;
+
+    // maps the file and checks that every range in it lies inside the mapping
+    bool Open(const std::string &path)
+    {
+        if (!file.Open(path))
+            return false;
+        if (file.size < sizeof(LightmapHeader))
+            return fail();
+        header = reinterpret_cast<const LightmapHeader *>(file.data);
+        if (header->magic != LIGHTMAP_MAGIC || header->version != LIGHTMAP_VERSION)
+            return fail();
+        uint64_t meshesEnd = sizeof(LightmapHeader) + (uint64_t)header->meshCount * sizeof(LightmapMesh);
+        uint64_t lightsEnd = meshesEnd + (uint64_t)header->lightCount * sizeof(LightmapLight);
+        uint64_t texelsEnd = header->texelDataOffset + (uint64_t)header->width * header->height * 4 * sizeof(uint16_t);
+        if (lightsEnd > file.size || header->vertexDataOffset > file.size || header->indexDataOffset > file.size ||
+            texelsEnd > file.size)
+            return fail();
+        meshes = reinterpret_cast<const LightmapMesh *>(file.data + sizeof(LightmapHeader));
+        lights = reinterpret_cast<const LightmapLight *>(file.data + meshesEnd);
+        vertices = reinterpret_cast<const LightmapVertex *>(file.data + header->vertexDataOffset);
+        indices = reinterpret_cast<const unsigned int *>(file.data + header->indexDataOffset);
+        texels = reinterpret_cast<const uint16_t *>(file.data + header->texelDataOffset);
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const LightmapMesh &m = meshes[i];
+            if (header->vertexDataOffset + ((uint64_t)m.firstVertex + m.vertexCount) * sizeof(LightmapVertex) > file.size ||
+                header->indexDataOffset + ((uint64_t)m.firstIndex + m.indexCount) * sizeof(unsigned int) > file.size)
+                return fail();
+        }
+        return true;
+    }
+
+    // the baked geometry of mesh index, when it was baked from exactly the loaded vertices and indices
+    bool MeshGeometry(unsigned int mesh, const Vertex *loadedVertices, size_t loadedVertexCount,
+                      const unsigned int *loadedIndices, size_t loadedIndexCount, std::vector<Vertex> &bakedVertices,
+                      std::vector<unsigned int> &bakedIndices) const
+    {
+        if (!header || mesh >= header->meshCount)
+            return false;
+        const LightmapMesh &m = meshes[mesh];
+        if (m.geometryHash != HashMeshGeometry(loadedVertices, loadedVertexCount, loadedIndices, loadedIndexCount))
+            return false;
+        bakedVertices.resize(m.vertexCount);
+        for (uint32_t i = 0; i < m.vertexCount; i++)
+        {
+            const LightmapVertex &v = vertices[m.firstVertex + i];
+            if (v.source >= loadedVertexCount)
+                return false;
+            bakedVertices[i] = loadedVertices[v.source];
+            bakedVertices[i].LightmapCoords = v.coords;
+        }
+        bakedIndices.assign(indices + m.firstIndex, indices + m.firstIndex + m.indexCount);
+        for (unsigned int index : bakedIndices)
+            if (index >= m.vertexCount)
+                return false;
+        return true;
+    }
+
+    // the texels as a filtered GL_RGBA16F texture, the mapping stays open for the meshes
+    unsigned int Upload()
+    {
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, header->width, header->height, 0, GL_RGBA, GL_HALF_FLOAT, texels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        std::cout << "LIGHTMAP::UPLOAD " << header->width << "x" << header->height << ", " << Bytes() / (1024.0 * 1024.0)
+                  << " MB, " << header->lightCount << " lights baked in " << header->bakeMs << " ms" << std::endl;
+        return texture;
+    }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        if (texture)
+            GLState::Get().DeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+    bool IsOpen() const { return header != nullptr; }
+    unsigned int Texture() const { return texture; }
+    uint32_t Width() const { return header ? header->width : 0; }
+    uint32_t Height() const { return header ? header->height : 0; }
+    size_t Bytes() const { return (size_t)Width() * Height() * 4 * sizeof(uint16_t); }
+    uint64_t LightsHash() const { return header ? header->lightsHash : 0; }
+    uint32_t LightCount() const { return header ? header->lightCount : 0; }
+    double BakeMs() const { return header ? header->bakeMs : 0.0; }
+    const LightmapLight &Light(uint32_t index) const { return lights[index]; }
+
+    // the static lights the program hands the baker, through a temporary file like the caches
+    static bool WriteLights(const std::string &path, const std::vector<LightmapLight> &lights)
+    {
+        uint32_t head[3] = {LIGHTMAP_LIGHTS_MAGIC, LIGHTMAP_VERSION, (uint32_t)lights.size()};
+        std::string tmpPath = path + ".tmp";
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char *>(head), sizeof(head));
+        out.write(reinterpret_cast<const char *>(lights.data()), lights.size() * sizeof(LightmapLight));
+        out.close();
+        if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    static bool ReadLights(const std::string &path, std::vector<LightmapLight> &lights)
+    {
+        MappedFile in;
+        uint32_t head[3];
+        if (!in.Open(path) || in.size < sizeof(head))
+            return false;
+        memcpy(head, in.data, sizeof(head));
+        if (head[0] != LIGHTMAP_LIGHTS_MAGIC || head[1] != LIGHTMAP_VERSION ||
+            sizeof(head) + (uint64_t)head[2] * sizeof(LightmapLight) > in.size)
+            return false;
+        lights.resize(head[2]);
+        memcpy(lights.data(), in.data + sizeof(head), lights.size() * sizeof(LightmapLight));
+        return true;
+    }
+
+    static bool Write(const std::string &path, const Bake &bake)
+    {
+        LightmapHeader header = {};
+        header.magic = LIGHTMAP_MAGIC;
+        header.version = LIGHTMAP_VERSION;
+        header.width = bake.width;
+        header.height = bake.height;
+        header.meshCount = bake.meshes.size();
+        header.lightCount = bake.lights.size();
+        header.lightsHash = HashLights(bake.lights);
+        header.vertexDataOffset = sizeof(LightmapHeader) + bake.meshes.size() * sizeof(LightmapMesh) +
+                                  bake.lights.size() * sizeof(LightmapLight);
+        header.indexDataOffset = header.vertexDataOffset + bake.vertices.size() * sizeof(LightmapVertex);
+        header.texelDataOffset = header.indexDataOffset + bake.indices.size() * sizeof(unsigned int);
+        header.bakeMs = bake.bakeMs;
+
+        std::string tmpPath = path + ".tmp";
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(bake.meshes.data()), bake.meshes.size() * sizeof(LightmapMesh));
+        out.write(reinterpret_cast<const char *>(bake.lights.data()), bake.lights.size() * sizeof(LightmapLight));
+        out.write(reinterpret_cast<const char *>(bake.vertices.data()), bake.vertices.size() * sizeof(LightmapVertex));
+        out.write(reinterpret_cast<const char *>(bake.indices.data()), bake.indices.size() * sizeof(unsigned int));
+        out.write(reinterpret_cast<const char *>(bake.texels.data()), bake.texels.size() * sizeof(uint16_t));
+        out.close();
+        if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    MappedFile file;
+    const LightmapHeader *header = nullptr;
+    const LightmapMesh *meshes = nullptr;
+    const LightmapLight *lights = nullptr;
+    const LightmapVertex *vertices = nullptr;
+    const unsigned int *indices = nullptr;
+    const uint16_t *texels = nullptr;
+    unsigned int texture = 0;
+
+    bool fail()
+    {
+        file.Close();
+        header = nullptr;
+        return false;
+    }
+};
+#endif
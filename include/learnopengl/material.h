@@ -0,0 +1,125 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/render_stats.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum TextureType {
+    TEXTURE_DIFFUSE = 0,
+    TEXTURE_SPECULAR,
+    TEXTURE_NORMAL,
+    TEXTURE_HEIGHT,
+    TEXTURE_TYPE_COUNT
+};
+
+// the sampler name prefix in the shaders, also how the type is written to the mesh cache
+inline const char *TextureTypeName(TextureType type)
+{
+    static const char *names[TEXTURE_TYPE_COUNT] = {"texture_diffuse", "texture_specular", "texture_normal",
+                                                    "texture_height"};
+    return names[type];
+}
+
+inline TextureType TextureTypeFromName(const std::string &name)
+{
+    for (int type = 0; type < TEXTURE_TYPE_COUNT; type++)
+        if (name == TextureTypeName((TextureType)type))
+            return (TextureType)type;
+    return TEXTURE_DIFFUSE;
+}
+
+struct Texture {
+    unsigned int id;
+    TextureType type;
+    std::string path;
+};
+
+// units 0..MATERIAL_TEXTURE_UNITS-1 belong to the mesh materials. The unit of a sampler depends only on its
+// name (texture_specular1 is always unit 1, texture_diffuse2 unit 4, ...), so every mesh drawn with a program
+// wants the same sampler uniform values and they are set once per program instead of once per draw.
+const int MATERIAL_TEXTURE_UNITS = 8;
+
+inline int MaterialTextureUnit(TextureType type, unsigned int number)
+{
+    return type + TEXTURE_TYPE_COUNT * (number - 1);
+}
+
+// The sampler bindings of one mesh, for each program it is drawn with: which of its textures goes to which
+// unit. The first draw with a program looks the sampler locations up and sets them; after that Bind() is a
+// loop over a few ints. Deleting a program (a reload) drops them all, GL may reuse its name.
+class Material
+{
+public:
+    // called with program in use
+    void Bind(unsigned int program, const std::vector<Texture> &textures, const std::string &prefix)
+    {
+        const Resolved *resolved = find(program, prefix);
+        if (resolved)
+            // the per draw loop this replaced built each sampler's name and called glGetUniformLocation with it
+            RenderStats::Frame().locationQueriesSaved += textures.size();
+        else
+            resolved = &resolve(program, textures, prefix);
+        // GLState drops the binds of textures the unit already holds
+        for (const Binding &binding : resolved->bindings)
+            GLState::Get().BindTextureUnit(binding.unit, GL_TEXTURE_2D, textures[binding.texture].id);
+    }
+
+private:
+    struct Binding {
+        unsigned int texture;  // index into the mesh's textures
+        int unit;
+    };
+    struct Resolved {
+        unsigned int program;
+        std::string prefix;
+        std::vector<Binding> bindings;
+    };
+    std::vector<Resolved> programs;
+    unsigned int programGeneration = 0;
+
+    const Resolved *find(unsigned int program, const std::string &prefix)
+    {
+        if (programGeneration != GLState::Get().ProgramGeneration())
+        {
+            programs.clear();
+            programGeneration = GLState::Get().ProgramGeneration();
+        }
+        for (const Resolved &resolved : programs)
+            if (resolved.program == program && resolved.prefix == prefix)
+                return &resolved;
+        return nullptr;
+    }
+
+    const Resolved &resolve(unsigned int program, const std::vector<Texture> &textures, const std::string &prefix)
+    {
+        programs.push_back({program, prefix, {}});
+        Resolved &resolved = programs.back();
+        unsigned int numbers[TEXTURE_TYPE_COUNT] = {1, 1, 1, 1};
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            TextureType type = textures[i].type;
+            unsigned int number = numbers[type]++;
+            std::string name = prefix + TextureTypeName(type) + std::to_string(number);
+            int unit = MaterialTextureUnit(type, number);
+            if (unit >= MATERIAL_TEXTURE_UNITS)
+            {
+                std::cout << "MATERIAL::RESOLVE " << name << ": out of material texture units, skipped" << std::endl;
+                continue;
+            }
+            GLint location = glGetUniformLocation(program, name.c_str());
+            // a sampler the program doesn't read needs no texture either
+            if (location < 0)
+                continue;
+            glUniform1i(location, unit);
+            resolved.bindings.push_back({i, unit});
+        }
+        return resolved;
+    }
+};
+#endif
@@ -0,0 +1,292 @@
+#ifndef MATERIAL_ARRAY_H
+#define MATERIAL_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/dds.h>
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/model.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_loader.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Draws the meshes of a packed Model that differ only in their diffuse texture with one
+// glMultiDrawElementsIndirect. The largest set of diffuse textures with the same size and format is copied
+// into a GL_TEXTURE_2D_ARRAY, from the finest mip level that fits the budget, and every indirect command
+// carries its layer in baseInstance, which the vertex shader hands on as gl_BaseInstance. Meshes outside
+// that set are drawn one by one afterwards. When the model isn't packed or the GL lacks the 4.3 entry points,
+// Build() says why and Draw() is just Model::Draw().
+class MaterialArray
+{
+public:
+    // texture unit of the array, away from the units Mesh::Draw binds its sampler2Ds to
+    static const int TEXTURE_UNIT = 8;
+
+    MaterialArray() = default;
+    MaterialArray(const MaterialArray &) = delete;
+    MaterialArray &operator=(const MaterialArray &) = delete;
+
+    // frees the array and the command buffer; call while the GL context is still current
+    void Release()
+    {
+        if (arrayTexture)
+            GLState::Get().DeleteTextures(1, &arrayTexture);
+        if (indirectBuffer)
+            glDeleteBuffers(1, &indirectBuffer);
+        arrayTexture = indirectBuffer = 0;
+    }
+
+    bool Build(const Model &model, const std::string &name, size_t budgetBytes)
+    {
+        if (!GLExtensions::Get().MultiDrawElementsIndirect)
+            return fallback(name, "glMultiDrawElementsIndirect is not available");
+        if (model.meshes.empty() || !model.meshes[0].packed)
+            return fallback(name, "the model's geometry is not packed");
+
+        // the candidates: meshes whose only texture is a diffuse map
+        std::map<unsigned int, Source> sources;
+        for (const Mesh &mesh : model.meshes)
+            if (mesh.textures.size() == 1 && mesh.textures[0].type == TEXTURE_DIFFUSE &&
+                !sources.count(mesh.textures[0].id))
+                describe(mesh.textures[0].id, sources[mesh.textures[0].id]);
+
+        // the biggest group of textures that can share one array
+        std::map<std::tuple<int, int, GLenum>, std::vector<unsigned int>> groups;
+        for (const auto &it : sources)
+            if (it.second.width > 0)
+                groups[std::make_tuple(it.second.width, it.second.height, it.second.internalFormat)].push_back(it.first);
+        const std::vector<unsigned int> *group = nullptr;
+        for (const auto &it : groups)
+            if (!group || it.second.size() > group->size())
+                group = &it.second;
+        if (!group || group->size() < 2)
+            return fallback(name, "fewer than two diffuse textures share a size and format");
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        if ((GLint)group->size() > maxLayers)
+            return fallback(name, "more textures than GL_MAX_ARRAY_TEXTURE_LAYERS");
+        const Source &first = sources[(*group)[0]];
+        if (!first.cooked && !GLExtensions::Get().CopyImageSubData)
+            return fallback(name, "glCopyImageSubData is not available for the uncompressed textures");
+
+        // every layer must have the level the array starts at, then drop levels until the array fits
+        unsigned int levelCount = first.levelCount;
+        for (unsigned int id : *group)
+            levelCount = std::min(levelCount, sources[id].levelCount);
+        unsigned int baseLevel = 0;
+        while (baseLevel + 1 < levelCount && group->size() * chainBytes(first, baseLevel, levelCount) > budgetBytes)
+            baseLevel++;
+        levels = levelCount - baseLevel;
+        layers = group->size();
+        width = std::max(1, first.width >> baseLevel);
+        height = std::max(1, first.height >> baseLevel);
+        bytes = layers * chainBytes(first, baseLevel, levelCount);
+
+        glGenTextures(1, &arrayTexture);
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+        for (unsigned int l = 0; l < levels; l++)
+        {
+            int w = std::max(1, width >> l), h = std::max(1, height >> l);
+            if (first.cooked)
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, first.internalFormat, w, h, layers, 0,
+                                       DdsLevelSize(first.dds.format, w, h) * layers, nullptr);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, l, first.internalFormat, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // cooked layers come straight from the mapped .dds (the 2D texture may have streamed its fine levels
+        // out), the others are copied on the GPU from their full mip chain
+        std::map<unsigned int, unsigned int> layerOf;
+        for (unsigned int layer = 0; layer < layers; layer++)
+        {
+            unsigned int id = (*group)[layer];
+            const Source &source = sources[id];
+            for (unsigned int l = 0; l < levels; l++)
+            {
+                int w = std::max(1, width >> l), h = std::max(1, height >> l);
+                if (source.cooked)
+                {
+                    const DdsLevel &level = source.dds.levels[baseLevel + l];
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, layer, w, h, 1, first.internalFormat,
+                                              level.size, source.file->data + level.offset);
+                }
+                else
+                    GLExtensions::Get().CopyImageSubData(id, GL_TEXTURE_2D, baseLevel + l, 0, 0, 0, arrayTexture,
+                                                         GL_TEXTURE_2D_ARRAY, l, 0, 0, layer, w, h, 1);
+            }
+            layerOf[id] = layer;
+            textures.push_back(id);
+        }
+
+        // one command per mesh in the array, in model order so the import time ordering is kept
+        struct DrawElementsIndirectCommand {
+            GLuint count, instanceCount, firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+        std::vector<DrawElementsIndirectCommand> commands;
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            const Mesh &mesh = model.meshes[i];
+            auto it = mesh.textures.size() == 1 ? layerOf.find(mesh.textures[0].id) : layerOf.end();
+            if (it == layerOf.end())
+            {
+                separateMeshes.push_back(i);
+                continue;
+            }
+            size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+            commands.push_back({mesh.indexCount, 1, (GLuint)(mesh.indexOffset / indexSize), mesh.baseVertex, it->second});
+        }
+        indexType = model.meshes[0].indexType;
+        vertexArray = model.meshes[0].VAO;
+        drawCount = commands.size();
+        glGenBuffers(1, &indirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        std::cout << "MATERIAL::ARRAY " << name << ": " << layers << " layers " << width << "x" << height
+                  << (first.cooked ? " compressed" : "") << " from mip " << baseLevel << ", "
+                  << bytes / (1024.0 * 1024.0) << " MB, " << drawCount << " meshes in one draw, "
+                  << separateMeshes.size() << " drawn separately" << std::endl;
+        return true;
+    }
+
+    // the array takes the diffuse map from diffuseArray instead of texture_diffuse1 while useDiffuseArray is set
+    void Draw(Model &model, Shader &shader)
+    {
+        if (!Active())
+        {
+            model.Draw(shader);
+            return;
+        }
+        GLState::Get().BindVertexArray(vertexArray);
+        drawIndirect(this, shader);
+        for (unsigned int i : separateMeshes)
+            model.meshes[i].Draw(shader);
+    }
+
+    // the same as Draw() through a RenderQueue: the indirect draw is one command, the separate meshes their own
+    void Record(RenderQueue &queue, RenderPass pass, Model &model, Shader &shader, const glm::mat4 *transform)
+    {
+        if (!Active())
+        {
+            queue.Push(pass, shader, model, transform);
+            return;
+        }
+        queue.Push(pass, shader, transform, vertexArray, arrayTexture, 0.0f, drawIndirect, this);
+        for (unsigned int i : separateMeshes)
+            queue.Push(pass, shader, model.meshes[i], transform);
+    }
+
+    bool Active() const { return arrayTexture != 0; }
+    // the 2D textures whose contents live in the array
+    const std::vector<unsigned int> &Textures() const { return textures; }
+    unsigned int Layers() const { return layers; }
+    unsigned int DrawCount() const { return drawCount; }
+    size_t SeparateCount() const { return separateMeshes.size(); }
+
+private:
+    struct Source {
+        int width = 0, height = 0;
+        GLenum internalFormat = 0;
+        unsigned int levelCount = 0;
+        bool cooked = false;
+        std::shared_ptr<MappedFile> file;
+        DdsImage dds;
+    };
+
+    unsigned int arrayTexture = 0;
+    unsigned int indirectBuffer = 0;
+    unsigned int vertexArray = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    unsigned int layers = 0, levels = 0, drawCount = 0;
+    int width = 0, height = 0;
+    size_t bytes = 0;
+    std::vector<unsigned int> textures;
+    std::vector<unsigned int> separateMeshes;
+
+    // with the vertex array bound; diffuseArray's unit is set on link, useDiffuseArray only for this one draw
+    static void drawIndirect(void *context, Shader &shader)
+    {
+        MaterialArray &array = *static_cast<MaterialArray *>(context);
+        GLState::Get().BindTextureUnit(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, array.arrayTexture);
+        shader.setBool("useDiffuseArray", true);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, array.indirectBuffer);
+        GLExtensions::Get().MultiDrawElementsIndirect(GL_TRIANGLES, array.indexType, nullptr, array.drawCount, 0);
+        RenderStats::Frame().drawCalls++;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        shader.setBool("useDiffuseArray", false);
+    }
+
+    static bool fallback(const std::string &name, const char *reason)
+    {
+        std::cout << "MATERIAL::ARRAY " << name << ": " << reason << ", drawing mesh by mesh" << std::endl;
+        return false;
+    }
+
+    // size and format of a loaded texture; compressed ones were loaded from their .dds, which is mapped again
+    static void describe(unsigned int id, Source &source)
+    {
+        GLint baseLevel = 0, compressed = 0, internalFormat = 0;
+        GLState::Get().BindTexture(GL_TEXTURE_2D, id);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_COMPRESSED, &compressed);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        if (compressed)
+        {
+            source.file = std::make_shared<MappedFile>();
+            std::string path = TextureCache::Instance().Path(id);
+            if (path.empty() || !source.file->Open(DdsPathFor(path)) ||
+                !DdsParse(source.file->data, source.file->size, source.dds))
+                return;
+            source.cooked = true;
+            source.width = source.dds.width;
+            source.height = source.dds.height;
+            source.levelCount = source.dds.levels.size();
+            source.internalFormat = internalFormat;   // the loader's pick, sRGB or not
+        }
+        else
+        {
+            GLint w = 0, h = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+            source.width = w;
+            source.height = h;
+            source.internalFormat = internalFormat;
+            for (int size = std::max(w, h); size > 0; size >>= 1)
+                source.levelCount++;
+        }
+    }
+
+    // bytes of one layer from baseLevel down, uncompressed texels counted as 4 bytes
+    static size_t chainBytes(const Source &source, unsigned int baseLevel, unsigned int levelCount)
+    {
+        size_t total = 0;
+        for (unsigned int l = baseLevel; l < levelCount; l++)
+        {
+            int w = std::max(1, source.width >> l), h = std::max(1, source.height >> l);
+            total += source.cooked ? DdsLevelSize(source.dds.format, w, h) : (size_t)w * h * 4;
+        }
+        return total;
+    }
+};
+#endif
@@ -6,8 +6,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/material.h>
+#include <learnopengl/render_stats.h>
 #include <learnopengl/shader.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 using namespace std;
@@ -23,14 +29,212 @@ struct Vertex {
     glm::vec3 Tangent;
     // bitangent
     glm::vec3 Bitangent;
+    // second UV set, into the model's lightmap (lightmap.h); zero for meshes that have none
+    glm::vec2 LightmapCoords;
 };
 
+// attribute locations, matching the layout (location = N) qualifiers in the shaders
+enum VertexAttribute {
+    ATTRIB_POSITION = 0,
+    ATTRIB_NORMAL,
+    ATTRIB_TEXCOORDS,
+    ATTRIB_TANGENT,
+    ATTRIB_BITANGENT,
+    ATTRIB_LIGHTMAP,
+    ATTRIB_COUNT
+};
+
+// which attributes a mesh uploads and how they are stored on the GPU. The default uploads the whole Vertex
+// as floats; a compact format stores normals and tangents as 10_10_10_2 and texture coordinates as 16 bit
+// unorm (for meshes whose UVs stay inside [0, 1]; lightmap coordinates always do), which the shaders read as
+// the same vec3/vec2 as before.
+struct VertexFormat {
+    unsigned int attributes = (1u << ATTRIB_COUNT) - 1;  // one bit per attribute location
+    bool compact = false;
 
+    bool Has(VertexAttribute attribute) const { return (attributes & (1u << attribute)) != 0; }
 
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+    // only the attributes the linked program actually reads, in the compact encodings
+    static VertexFormat ForProgram(unsigned int program)
+    {
+        VertexFormat format;
+        format.attributes = 1u << ATTRIB_POSITION;
+        format.compact = true;
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        vector<char> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            glGetActiveAttrib(program, i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+            // built-ins such as gl_VertexID are reported too, they have no location
+            GLint location = glGetAttribLocation(program, name.data());
+            if (location >= 0 && location < ATTRIB_COUNT)
+                format.attributes |= 1u << location;
+        }
+        return format;
+    }
+};
+
+// where each attribute of a format sits in an interleaved GPU buffer. Every attribute takes a multiple of
+// 4 bytes; the layout of the default format is exactly the Vertex struct.
+struct VertexLayout {
+    VertexFormat format;
+    bool shortTexCoords = false;
+    unsigned int stride = 0;
+    unsigned int offsets[ATTRIB_COUNT] = {};
+
+    VertexLayout() {}
+
+    VertexLayout(const VertexFormat &format, bool texCoordsFit) : format(format)
+    {
+        shortTexCoords = format.compact && texCoordsFit;
+        unsigned int sizes[ATTRIB_COUNT] = {12, format.compact ? 4u : 12u, shortTexCoords ? 4u : 8u,
+                                            format.compact ? 4u : 12u, format.compact ? 4u : 12u,
+                                            format.compact ? 4u : 8u};
+        for (int a = 0; a < ATTRIB_COUNT; a++)
+            if (format.Has((VertexAttribute)a))
+            {
+                offsets[a] = stride;
+                stride += sizes[a];
+            }
+    }
+
+    // 16 bit texture coordinates only cover [0, 1], tiled UVs stay float
+    static bool FitsShortTexCoords(const Vertex *vertices, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const Vertex &v = vertices[i];
+            if (v.TexCoords.x < 0.0f || v.TexCoords.x > 1.0f || v.TexCoords.y < 0.0f || v.TexCoords.y > 1.0f)
+                return false;
+        }
+        return true;
+    }
+    static bool FitsShortTexCoords(const vector<Vertex> &vertices)
+    {
+        return FitsShortTexCoords(vertices.data(), vertices.size());
+    }
+
+    bool IsFull() const { return !format.compact && format.attributes == VertexFormat().attributes; }
+
+    void Pack(const Vertex *vertices, size_t count, unsigned char *out) const
+    {
+        if (IsFull())
+        {
+            memcpy(out, vertices, count * sizeof(Vertex));
+            return;
+        }
+        for (size_t i = 0; i < count; i++, out += stride)
+        {
+            const Vertex &v = vertices[i];
+            memcpy(out + offsets[ATTRIB_POSITION], &v.Position, 12);
+            const glm::vec3 *frames[ATTRIB_COUNT] = {nullptr, &v.Normal, nullptr, &v.Tangent, &v.Bitangent};
+            for (int a : {ATTRIB_NORMAL, ATTRIB_TANGENT, ATTRIB_BITANGENT})
+            {
+                if (!format.Has((VertexAttribute)a))
+                    continue;
+                if (format.compact)
+                {
+                    uint32_t p = packSnorm1010102(*frames[a]);
+                    memcpy(out + offsets[a], &p, 4);
+                }
+                else
+                    memcpy(out + offsets[a], frames[a], 12);
+            }
+            if (format.Has(ATTRIB_TEXCOORDS))
+            {
+                if (shortTexCoords)
+                {
+                    uint16_t uv[2] = {packUnorm16(v.TexCoords.x), packUnorm16(v.TexCoords.y)};
+                    memcpy(out + offsets[ATTRIB_TEXCOORDS], uv, 4);
+                }
+                else
+                    memcpy(out + offsets[ATTRIB_TEXCOORDS], &v.TexCoords, 8);
+            }
+            if (format.Has(ATTRIB_LIGHTMAP))
+            {
+                if (format.compact)
+                {
+                    uint16_t uv[2] = {packUnorm16(v.LightmapCoords.x), packUnorm16(v.LightmapCoords.y)};
+                    memcpy(out + offsets[ATTRIB_LIGHTMAP], uv, 4);
+                }
+                else
+                    memcpy(out + offsets[ATTRIB_LIGHTMAP], &v.LightmapCoords, 8);
+            }
+        }
+    }
+
+    // attribute pointers for the bound vertex array and GL_ARRAY_BUFFER
+    void SetAttributes() const
+    {
+        glEnableVertexAttribArray(ATTRIB_POSITION);
+        glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        for (int a : {ATTRIB_NORMAL, ATTRIB_TANGENT, ATTRIB_BITANGENT})
+        {
+            if (!format.Has((VertexAttribute)a))
+                continue;
+            glEnableVertexAttribArray(a);
+            // packed 10_10_10_2 must be given as 4 components, the shader's vec3 just ignores w
+            if (format.compact)
+                glVertexAttribPointer(a, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(uintptr_t)offsets[a]);
+            else
+                glVertexAttribPointer(a, 3, GL_FLOAT, GL_FALSE, stride, (void*)(uintptr_t)offsets[a]);
+        }
+        if (format.Has(ATTRIB_TEXCOORDS))
+        {
+            glEnableVertexAttribArray(ATTRIB_TEXCOORDS);
+            if (shortTexCoords)
+                glVertexAttribPointer(ATTRIB_TEXCOORDS, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(uintptr_t)offsets[ATTRIB_TEXCOORDS]);
+            else
+                glVertexAttribPointer(ATTRIB_TEXCOORDS, 2, GL_FLOAT, GL_FALSE, stride, (void*)(uintptr_t)offsets[ATTRIB_TEXCOORDS]);
+        }
+        if (format.Has(ATTRIB_LIGHTMAP))
+        {
+            glEnableVertexAttribArray(ATTRIB_LIGHTMAP);
+            if (format.compact)
+                glVertexAttribPointer(ATTRIB_LIGHTMAP, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(uintptr_t)offsets[ATTRIB_LIGHTMAP]);
+            else
+                glVertexAttribPointer(ATTRIB_LIGHTMAP, 2, GL_FLOAT, GL_FALSE, stride, (void*)(uintptr_t)offsets[ATTRIB_LIGHTMAP]);
+        }
+    }
+
+    static uint32_t packSnorm1010102(const glm::vec3 &v)
+    {
+        glm::vec3 n = glm::clamp(v, -1.0f, 1.0f) * 511.0f;
+        uint32_t x = (uint32_t)(int32_t)std::round(n.x) & 0x3ff;
+        uint32_t y = (uint32_t)(int32_t)std::round(n.y) & 0x3ff;
+        uint32_t z = (uint32_t)(int32_t)std::round(n.z) & 0x3ff;
+        return x | (y << 10) | (z << 20);
+    }
+
+    static uint16_t packUnorm16(float v)
+    {
+        return (uint16_t)std::round(std::min(std::max(v, 0.0f), 1.0f) * 65535.0f);
+    }
+};
+
+
+
+// bytes of CPU side vertex and index data held by all meshes, to see what keeping the geometry around costs
+struct GeometryStats {
+    size_t currentBytes = 0;
+    size_t peakBytes = 0;
+
+    static GeometryStats &Get()
+    {
+        static GeometryStats stats;
+        return stats;
+    }
+
+    void Add(size_t bytes)
+    {
+        currentBytes += bytes;
+        peakBytes = std::max(peakBytes, currentBytes);
+    }
+    void Remove(size_t bytes) { currentBytes -= bytes; }
 };
 
 class Mesh {
@@ -41,99 +245,207 @@ public:
     vector<Texture>      textures;
 
     unsigned int VAO;
+    unsigned int indexCount;
+    unsigned int vertexCount;
+    unsigned int vertexStride;  // bytes per vertex in the GPU buffer
+    GLenum indexType;           // GL_UNSIGNED_SHORT when every index fits, GL_UNSIGNED_INT otherwise
+    // set when the mesh lives in its Model's shared buffers: VAO is the model's and the caller binds it
+    bool packed = false;
+    size_t indexOffset = 0;     // in bytes, into the shared index buffer
+    int baseVertex = 0;
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // sampler bindings for the program the mesh was last drawn with
+    Material material;
+    // object space bounding box of the vertices
+    glm::vec3 boundsMin, boundsMax;
+    // constructor, takes over the buffers it is given (pass them with std::move to avoid copies).
+    // Without upload no GL buffers are made, the Model packs the mesh into its own and calls UsePackedRange().
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         const VertexFormat &format = VertexFormat(), bool upload = true)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        indexCount = this->indices.size();
+        vertexCount = this->vertices.size();
+        GeometryStats::Get().Add(cpuBytes());
 
+        computeBounds(this->vertices.data());
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (upload)
+            setupMesh(format, this->vertices.data(), this->indices.data());
+        else
+            VAO = VBO = EBO = 0;
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // a mesh whose geometry stays where it is (a mapped mesh cache): uploaded from there, no CPU copy is kept.
+    // Without upload the pointers must stay valid until the Model has packed or uploaded the mesh.
+    Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount,
+         vector<Texture> textures, const VertexFormat &format, bool upload)
+        : textures(std::move(textures)), indexCount(indexCount), vertexCount(vertexCount)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        computeBounds(vertexData);
+        if (upload)
+            setupMesh(format, vertexData, indexData);
+        else
+            VAO = VBO = EBO = 0;
+    }
+
+    // meshes own their geometry buffers, so they are moved around but never copied. A moved from mesh is left
+    // with empty vectors, so the GeometryStats bytes go with the move. Assignment would drop the target's
+    // buffers without giving them back to GeometryStats (or GL), the vector of meshes never needs it
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+    Mesh(Mesh &&) = default;
+    Mesh &operator=(Mesh &&) = delete;
+
+    ~Mesh()
+    {
+        GeometryStats::Get().Remove(cpuBytes());
+    }
 
+    // frees the CPU copy of the vertices and indices once they live on the GPU; bounds and indexCount stay valid
+    void ReleaseCpuGeometry()
+    {
+        GeometryStats::Get().Remove(cpuBytes());
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
 
+    // swaps in new geometry before the mesh is uploaded, e.g. with the vertices a lightmap split along its seams
+    void ReplaceGeometry(vector<Vertex> newVertices, vector<unsigned int> newIndices)
+    {
+        GeometryStats::Get().Remove(cpuBytes());
+        vertices = std::move(newVertices);
+        indices = std::move(newIndices);
+        indexCount = indices.size();
+        vertexCount = vertices.size();
+        GeometryStats::Get().Add(cpuBytes());
+        computeBounds(vertices.data());
+    }
+
+    // for a mesh made without upload that isn't packed after all; the geometry is its own or wherever it was made from
+    void Upload(const VertexFormat &format, const Vertex *vertexData, const unsigned int *indexData)
+    {
+        setupMesh(format, vertexData, indexData);
+    }
+
+    void UsePackedRange(unsigned int sharedVAO, unsigned int stride, GLenum type, size_t firstIndexByte, int firstVertex)
+    {
+        packed = true;
+        VAO = sharedVAO;
+        vertexStride = stride;
+        indexType = type;
+        indexOffset = firstIndexByte;
+        baseVertex = firstVertex;
+    }
+
+    size_t cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+    }
+
+    // render the mesh
+    void Draw(Shader &shader)
+    {
+        // bind appropriate textures, the sampler locations are looked up once per program
+        material.Bind(shader.ID, textures, glslIdentifierPrefix);
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        if (indexCount == 0)
+            return;
+        if (packed)
+            glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, baseVertex);
+        else
+        {
+            GLState::Get().BindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+        }
+        RenderStats::Frame().drawCalls++;
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // the triangles only, for passes that read nothing but the positions (shadow depth)
+    void DrawGeometry()
+    {
+        if (indexCount == 0)
+            return;
+        if (packed)
+            glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, baseVertex);
+        else
+        {
+            GLState::Get().BindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+        }
+        RenderStats::Frame().drawCalls++;
     }
 
 private:
     // render data
     unsigned int VBO, EBO;
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    void computeBounds(const Vertex *vertexData)
+    {
+        boundsMin = boundsMax = vertexCount == 0 ? glm::vec3(0.0f) : vertexData[0].Position;
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            boundsMin = glm::min(boundsMin, vertexData[i].Position);
+            boundsMax = glm::max(boundsMax, vertexData[i].Position);
+        }
+    }
+
+    // the index buffer goes up as 16 bit whenever the mesh has few enough vertices, the CPU copy stays 32 bit
+    void uploadIndices(const unsigned int *indexData)
+    {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (vertexCount <= 65536)
+        {
+            indexType = GL_UNSIGNED_SHORT;
+            vector<uint16_t> shortIndices(indexData, indexData + indexCount);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            indexType = GL_UNSIGNED_INT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+        }
+    }
+
+    // initializes all the buffer objects/arrays from vertexCount vertices and indexCount indices; a mesh without
+    // triangles gets no buffers and draws nothing
+    void setupMesh(const VertexFormat &format, const Vertex *vertexData, const unsigned int *indexData)
     {
+        VertexLayout layout(format, VertexLayout::FitsShortTexCoords(vertexData, vertexCount));
+        vertexStride = layout.stride;
+        indexType = GL_UNSIGNED_INT;
+        if (vertexCount == 0 || indexCount == 0)
+        {
+            VAO = VBO = EBO = 0;
+            return;
+        }
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLState::Get().BindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        if (layout.IsFull())
+        {
+            // A great thing about structs is that their memory layout is sequential for all its items.
+            // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+            // again translates to 3/2 floats which translates to a byte array.
+            glBufferData(GL_ARRAY_BUFFER, (size_t)vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
+        }
+        else
+        {
+            vector<unsigned char> packed((size_t)vertexCount * layout.stride);
+            layout.Pack(vertexData, vertexCount, packed.data());
+            glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+        }
+        uploadIndices(indexData);
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        layout.SetAttributes();
     }
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,257 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// On-disk layout of a mesh cache file (all offsets are in bytes from the start of the file):
+//
+//   MeshCacheHeader
+//   MeshCacheEntry[meshCount]
+//   MeshCacheTexture[textureCount]
+//   char strings[stringsSize]          texture type names and paths, not zero terminated
+//   Vertex vertices[]                   (at vertexDataOffset, every mesh's vertices back to back)
+//   unsigned int indices[]              (at indexDataOffset, every mesh's indices back to back)
+//
+// The file is mapped read only and the vertex/index ranges are handed to the GPU as they are.
+const uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+const uint32_t MESH_CACHE_VERSION = 4;
+
+// processing done on top of the Assimp import, also part of the cache key
+const uint32_t MESH_CACHE_OPTIMIZED = 1u << 0;  // welded and reordered by OptimizeMesh()
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;    // MeshCache::SourceHash() of the source asset
+    uint32_t importFlags;   // aiPostProcessSteps the cached data was imported with
+    uint32_t pipelineFlags; // MESH_CACHE_* processing applied after the import
+    uint32_t vertexSize;    // sizeof(Vertex) when the cache was written
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+    double coldLoadMs;      // geometry import time of the run that wrote the cache
+};
+
+struct MeshCacheEntry {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t firstVertex;
+    uint32_t firstIndex;
+    uint32_t firstTexture;
+    uint32_t textureCount;
+};
+
+struct MeshCacheTexture {
+    uint32_t typeOffset;
+    uint32_t typeLength;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+class MeshCache
+{
+public:
+    static std::string PathFor(const std::string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // FNV-1a of the model file and of the material libraries its mtllib lines name (materials and texture
+    // paths live there), so editing either one makes the cache stale; 0 when the model can't be read
+    static uint64_t SourceHash(const std::string &sourcePath)
+    {
+        MappedFile source;
+        if (!source.Open(sourcePath))
+            return 0;
+        uint64_t hash = HashBytes(source.data, source.size);
+        std::string directory = sourcePath.substr(0, sourcePath.find_last_of('/'));
+        const char *line = reinterpret_cast<const char *>(source.data), *end = line + source.size;
+        while (line < end) {
+            const char *lineEnd = static_cast<const char *>(memchr(line, '\n', end - line));
+            if (!lineEnd)
+                lineEnd = end;
+            if (lineEnd - line > 7 && strncmp(line, "mtllib", 6) == 0 && (line[6] == ' ' || line[6] == '\t')) {
+                // one or more names separated by blanks; a missing library still counts by its name
+                const char *name = line + 7;
+                while (name < lineEnd) {
+                    while (name < lineEnd && isspace((unsigned char)*name))
+                        name++;
+                    const char *nameEnd = name;
+                    while (nameEnd < lineEnd && !isspace((unsigned char)*nameEnd))
+                        nameEnd++;
+                    if (nameEnd == name)
+                        break;
+                    std::string library(name, nameEnd);
+                    hash = HashBytes(library.data(), library.size(), hash);
+                    MappedFile contents;
+                    if (contents.Open(directory + '/' + library))
+                        hash = HashBytes(contents.data, contents.size, hash);
+                    name = nameEnd;
+                }
+            }
+            line = lineEnd + 1;
+        }
+        return hash;
+    }
+
+    // maps the cache file and checks that it was built from the same source (SourceHash) with the same import
+    // and processing flags; all of these together are the cache key
+    bool Open(const std::string &cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t pipelineFlags)
+    {
+        if (!Open(cachePath, sourceHash))
+            return false;
+        if (header->importFlags != importFlags || header->pipelineFlags != pipelineFlags)
+            return fail();
+        return true;
+    }
+
+    // the same with whatever import flags the program wrote it with, for tools that read its geometry
+    bool Open(const std::string &cachePath, uint64_t sourceHash)
+    {
+        if (!file.Open(cachePath))
+            return false;
+        if (file.size < sizeof(MeshCacheHeader))
+            return fail();
+        header = reinterpret_cast<const MeshCacheHeader *>(file.data);
+        if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+            header->vertexSize != sizeof(Vertex) || header->sourceHash != sourceHash)
+            return fail();
+
+        uint64_t entriesEnd = sizeof(MeshCacheHeader) + (uint64_t)header->meshCount * sizeof(MeshCacheEntry);
+        uint64_t texturesEnd = entriesEnd + (uint64_t)header->textureCount * sizeof(MeshCacheTexture);
+        if (texturesEnd > file.size || header->stringsOffset + header->stringsSize > file.size ||
+            header->vertexDataOffset > file.size || header->indexDataOffset > file.size)
+            return fail();
+        entries = reinterpret_cast<const MeshCacheEntry *>(file.data + sizeof(MeshCacheHeader));
+        textures = reinterpret_cast<const MeshCacheTexture *>(file.data + entriesEnd);
+        strings = reinterpret_cast<const char *>(file.data + header->stringsOffset);
+        vertices = reinterpret_cast<const Vertex *>(file.data + header->vertexDataOffset);
+        indices = reinterpret_cast<const unsigned int *>(file.data + header->indexDataOffset);
+
+        // every range must lie inside the mapping, a truncated file is treated like a stale one
+        for (uint32_t i = 0; i < header->meshCount; i++) {
+            const MeshCacheEntry &e = entries[i];
+            if (header->vertexDataOffset + ((uint64_t)e.firstVertex + e.vertexCount) * sizeof(Vertex) > file.size ||
+                header->indexDataOffset + ((uint64_t)e.firstIndex + e.indexCount) * sizeof(unsigned int) > file.size ||
+                (uint64_t)e.firstTexture + e.textureCount > header->textureCount)
+                return fail();
+        }
+        return true;
+    }
+
+    bool IsOpen() const { return header != nullptr; }
+    uint32_t MeshCount() const { return header->meshCount; }
+    double ColdLoadMs() const { return header->coldLoadMs; }
+    const MeshCacheEntry &Entry(uint32_t mesh) const { return entries[mesh]; }
+    const Vertex *Vertices(uint32_t mesh) const { return vertices + entries[mesh].firstVertex; }
+    const unsigned int *Indices(uint32_t mesh) const { return indices + entries[mesh].firstIndex; }
+
+    std::string TextureType(uint32_t texture) const
+    {
+        return std::string(strings + textures[texture].typeOffset, textures[texture].typeLength);
+    }
+    std::string TexturePath(uint32_t texture) const
+    {
+        return std::string(strings + textures[texture].pathOffset, textures[texture].pathLength);
+    }
+
+    // writes the final mesh data of a model; goes through a temporary file so a crash never leaves a torn cache behind
+    static bool Write(const std::string &cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t pipelineFlags,
+                      const std::vector<Mesh> &meshes, double coldLoadMs)
+    {
+        MeshCacheHeader header = {};
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.importFlags = importFlags;
+        header.pipelineFlags = pipelineFlags;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = meshes.size();
+        header.coldLoadMs = coldLoadMs;
+
+        std::vector<MeshCacheEntry> entries;
+        std::vector<MeshCacheTexture> textures;
+        std::string strings;
+        uint32_t vertexCount = 0, indexCount = 0;
+        for (const Mesh &mesh : meshes) {
+            MeshCacheEntry entry;
+            entry.vertexCount = mesh.vertices.size();
+            entry.indexCount = mesh.indices.size();
+            entry.firstVertex = vertexCount;
+            entry.firstIndex = indexCount;
+            entry.firstTexture = textures.size();
+            entry.textureCount = mesh.textures.size();
+            for (const Texture &texture : mesh.textures) {
+                MeshCacheTexture t;
+                t.typeOffset = strings.size();
+                const char *type = TextureTypeName(texture.type);
+                t.typeLength = strlen(type);
+                strings += type;
+                t.pathOffset = strings.size();
+                t.pathLength = texture.path.size();
+                strings += texture.path;
+                textures.push_back(t);
+            }
+            entries.push_back(entry);
+            vertexCount += entry.vertexCount;
+            indexCount += entry.indexCount;
+        }
+        header.textureCount = textures.size();
+        header.stringsOffset = sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry) +
+                               textures.size() * sizeof(MeshCacheTexture);
+        header.stringsSize = strings.size();
+        // keep the vertex array aligned so the mapped pointer can be used as a Vertex* directly
+        header.vertexDataOffset = (header.stringsOffset + header.stringsSize + 15) & ~(uint64_t)15;
+        header.indexDataOffset = header.vertexDataOffset + (uint64_t)vertexCount * sizeof(Vertex);
+
+        std::string tmpPath = cachePath + ".tmp";
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+        out.write(reinterpret_cast<const char *>(textures.data()), textures.size() * sizeof(MeshCacheTexture));
+        out.write(strings.data(), strings.size());
+        static const char padding[16] = {};
+        out.write(padding, header.vertexDataOffset - (header.stringsOffset + header.stringsSize));
+        for (const Mesh &mesh : meshes)
+            out.write(reinterpret_cast<const char *>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+        for (const Mesh &mesh : meshes)
+            out.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+        out.close();
+        if (!out || std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    MappedFile file;
+    const MeshCacheHeader *header = nullptr;
+    const MeshCacheEntry *entries = nullptr;
+    const MeshCacheTexture *textures = nullptr;
+    const char *strings = nullptr;
+    const Vertex *vertices = nullptr;
+    const unsigned int *indices = nullptr;
+
+    bool fail()
+    {
+        file.Close();
+        header = nullptr;
+        return false;
+    }
+};
+#endif
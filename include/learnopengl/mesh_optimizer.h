@@ -0,0 +1,296 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Import time optimization of triangle lists, run once before a model is written to the mesh cache:
+//
+//   1. WeldVertices          merges bit identical vertices (the OBJ importer emits one per face corner)
+//   2. OptimizeVertexCache   Tipsify (Sander, Nehab, Barczak 2007), reorders triangles for the post transform cache
+//   3. OptimizeOverdraw      sorts the Tipsify clusters so triangles facing out of the mesh are drawn first
+//   4. OptimizeVertexFetch   renumbers vertices in first use order so fetches walk the buffer linearly
+//
+// Cache efficiency is measured against a FIFO cache: ACMR is transformed vertices per triangle (0.5 is
+// the ideal for a large regular mesh, 3 is the worst), ATVR is transformed vertices per unique vertex (1 is ideal).
+
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+    size_t misses = 0;     // vertices the cache had to transform
+    size_t triangles = 0;
+    size_t vertices = 0;   // unique vertices referenced
+
+    float Acmr() const { return triangles ? (float)misses / triangles : 0.0f; }
+    float Atvr() const { return vertices ? (float)misses / vertices : 0.0f; }
+};
+
+struct MeshOptimizeStats {
+    size_t verticesBefore = 0, verticesAfter = 0;
+    size_t bytesBefore = 0, bytesAfter = 0;  // vertex plus index buffer as uploaded, at the mesh's vertex stride
+    VertexCacheStats before, after;
+
+    // sums the counts, so the ratios of the total read as if the meshes were one
+    void Add(const MeshOptimizeStats &other)
+    {
+        verticesBefore += other.verticesBefore;
+        verticesAfter += other.verticesAfter;
+        bytesBefore += other.bytesBefore;
+        bytesAfter += other.bytesAfter;
+        before.misses += other.before.misses;
+        before.triangles += other.before.triangles;
+        before.vertices += other.before.vertices;
+        after.misses += other.after.misses;
+        after.triangles += other.after.triangles;
+        after.vertices += other.after.vertices;
+    }
+};
+
+inline VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                           unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats;
+    stats.triangles = indices.size() / 3;
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    for (unsigned int index : indices)
+    {
+        if (!used[index])
+        {
+            used[index] = true;
+            stats.vertices++;
+        }
+        if (loadedAt[index] == 0 || stats.misses - loadedAt[index] >= cacheSize)
+            loadedAt[index] = ++stats.misses;
+    }
+    return stats;
+}
+
+// bytes a mesh takes on the GPU with vertexStride bytes a vertex and the narrowest index type that fits
+inline size_t MeshUploadBytes(size_t vertexCount, size_t indexCount, size_t vertexStride)
+{
+    return vertexCount * vertexStride + indexCount * (vertexCount <= 65536 ? 2 : 4);
+}
+
+inline void WeldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    struct VertexHash {
+        size_t operator()(const Vertex &v) const { return HashBytes(&v, sizeof(Vertex)); }
+    };
+    struct VertexEqual {
+        bool operator()(const Vertex &a, const Vertex &b) const { return memcmp(&a, &b, sizeof(Vertex)) == 0; }
+    };
+    std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        auto it = unique.insert(std::make_pair(vertices[i], count));
+        if (it.second)
+            vertices[count++] = vertices[i];
+        remap[i] = it.first->second;
+    }
+    vertices.resize(count);
+    for (unsigned int &index : indices)
+        index = remap[index];
+}
+
+// Tipsify: fans around the most recently used vertex that still has triangles left, and jumps to a vertex
+// that is likely still cached when that one is done. Returns the new index list; clusters gets the first
+// triangle of every fan that had to start with a cold cache, the points where the cache state is lost anyway.
+inline std::vector<unsigned int> OptimizeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                                     std::vector<unsigned int> &clusters,
+                                                     unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    size_t triangleCount = indices.size() / 3;
+    // vertex -> triangle adjacency
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (unsigned int index : indices)
+        liveTriangles[index]++;
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    clusters.clear();
+
+    unsigned int time = cacheSize + 1;
+    unsigned int cursor = 0;
+    int fanning = -1;
+    while (cursor < vertexCount && fanning < 0)
+        if (liveTriangles[cursor++] > 0)
+            fanning = cursor - 1;
+    bool restarted = true;
+    while (fanning >= 0)
+    {
+        if (restarted)
+            clusters.push_back(result.size() / 3);
+        candidates.clear();
+        for (unsigned int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++)
+        {
+            unsigned int triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[triangle * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // next fanning vertex: the candidate that stays in the cache longest while its fan is emitted
+        fanning = -1;
+        restarted = false;
+        unsigned int best = 0;
+        for (unsigned int v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+            unsigned int priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > best)
+            {
+                best = priority;
+                fanning = v;
+            }
+        }
+        if (fanning >= 0)
+            continue;
+        // dead end: back off to a recently used vertex, or walk on to the next one with triangles left.
+        // A cluster starts wherever the new fan can't reuse anything from the cache.
+        while (!deadEnd.empty() && fanning < 0)
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+                fanning = v;
+        }
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0)
+                fanning = cursor;
+            cursor++;
+        }
+        restarted = fanning >= 0 && time - cacheTime[fanning] > cacheSize;
+    }
+    return result;
+}
+
+// draws clusters that face away from the mesh center first: from most viewpoints those are the ones in front,
+// so they fill the depth buffer early and the fragments behind them get rejected
+inline void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices,
+                             const std::vector<unsigned int> &clusters)
+{
+    if (clusters.size() < 2)
+        return;
+    unsigned int triangleCount = indices.size() / 3;
+    glm::vec3 meshCenter(0.0f);
+    for (const Vertex &v : vertices)
+        meshCenter += v.Position;
+    meshCenter /= (float)std::max<size_t>(vertices.size(), 1);
+
+    struct Cluster {
+        unsigned int first, count;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted;
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        Cluster cluster;
+        cluster.first = clusters[c];
+        cluster.count = (c + 1 < clusters.size() ? clusters[c + 1] : triangleCount) - cluster.first;
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (unsigned int t = cluster.first; t < cluster.first + cluster.count; t++)
+        {
+            const glm::vec3 &a = vertices[indices[t * 3]].Position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &c2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, c2 - a);  // length is twice the area
+            float weight = glm::length(n);
+            center += (a + b + c2) * (weight / 3.0f);
+            normal += n;
+            area += weight;
+        }
+        center = area > 0.0f ? center / area : meshCenter;
+        float normalLength = glm::length(normal);
+        cluster.sortKey = normalLength > 0.0f ? glm::dot(center - meshCenter, normal / normalLength) : 0.0f;
+        sorted.push_back(cluster);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster &a, const Cluster &b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster &cluster : sorted)
+        result.insert(result.end(), indices.begin() + cluster.first * 3,
+                      indices.begin() + (cluster.first + cluster.count) * 3);
+    indices.swap(result);
+}
+
+// renumbers the vertices in the order the index buffer first touches them, unreferenced vertices are dropped
+inline void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int unset = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unset);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == unset)
+        {
+            remap[index] = result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+// the whole pipeline for one triangle list, returns what it changed; vertexStride is what the mesh uploads
+// per vertex (VertexLayout::stride), the bytes before are the imported mesh with 32 bit indices
+inline MeshOptimizeStats OptimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+                                      size_t vertexStride)
+{
+    MeshOptimizeStats stats;
+    stats.verticesBefore = vertices.size();
+    stats.bytesBefore = vertices.size() * vertexStride + indices.size() * sizeof(unsigned int);
+    stats.before = AnalyzeVertexCache(indices, vertices.size());
+
+    WeldVertices(vertices, indices);
+    std::vector<unsigned int> clusters;
+    indices = OptimizeVertexCache(indices, vertices.size(), clusters);
+    OptimizeOverdraw(indices, vertices, clusters);
+    OptimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = vertices.size();
+    stats.bytesAfter = MeshUploadBytes(vertices.size(), indices.size(), vertexStride);
+    stats.after = AnalyzeVertexCache(indices, vertices.size());
+    return stats;
+}
+#endif
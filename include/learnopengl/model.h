@@ -10,9 +10,16 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <learnopengl/lightmap.h>
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_loader.h>
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -23,53 +30,291 @@ using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
-
+struct ModelOptions {
+    bool gamma = false;
+    // the meshes drop their vertices and indices once they are on the GPU (and in the cache)
+    bool releaseCpuGeometry = false;
+    // what the meshes upload, usually VertexFormat::ForProgram() of the shader that draws the model
+    VertexFormat vertexFormat;
+    // weld and reorder the meshes for the vertex cache, overdraw and fetch locality when importing
+    bool optimizeMeshes = true;
+    // all meshes in one vertex and one index buffer under a single VAO, drawn with glDrawElementsBaseVertex
+    bool packGeometry = false;
+    // baked lighting for this model (lightmap_baker); the meshes it was baked for take its vertices and UVs
+    const Lightmap *lightmap = nullptr;
+};
 
 class Model
 {
 public:
+    // post processing applied to every imported model, also part of the mesh cache key.
+    // aiProcess_CalcTangentSpace is left out when the vertex format has no use for tangents.
+    static const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
     // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false) : Model(path, gammaOnly(gamma))
+    {
+    }
+
+    Model(string const &path, const ModelOptions &options)
+        : gammaCorrection(options.gamma), vertexFormat(options.vertexFormat), optimizeMeshes(options.optimizeMeshes),
+          packed(options.packGeometry), lightmap(options.lightmap)
     {
-        loadModel(path);
+        // a warm load uploads straight from the mapped cache, which stays mapped until every mesh is on the GPU
+        MeshCache cache;
+        loadModel(path, cache, !options.releaseCpuGeometry);
+        if (lightmap)
+            applyLightmap(path, cache);
+        if (packed)
+            packGeometry(cache);
+        reportVertexBandwidth(path);
+        if (options.releaseCpuGeometry)
+            for (Mesh &mesh : meshes)
+                mesh.ReleaseCpuGeometry();
     }
 
+    // the textures are shared through the TextureCache, every reference this model took is given back here
+    ~Model()
+    {
+        for (unsigned int id : textureReferences)
+            TextureCache::Instance().Release(id);
+    }
+
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
+        if (packed)
+            GLState::Get().BindVertexArray(VAO);
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
 
+    // without textures, for depth only passes
+    void DrawGeometry()
+    {
+        if (packed)
+            GLState::Get().BindVertexArray(VAO);
+        for (Mesh &mesh : meshes)
+            mesh.DrawGeometry();
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
         }
     }
 private:
+    // one entry per TextureCache::Acquire() made while loading
+    vector<unsigned int> textureReferences;
+
+    VertexFormat vertexFormat;
+    bool optimizeMeshes;
+    // shared buffers of a packed model
+    bool packed;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    // the meshes wait with their upload until the lightmap has changed their geometry
+    const Lightmap *lightmap;
+    MeshOptimizeStats optimizeTotals;
+
+    // time spent requesting textures while loading, kept apart so the cache report only compares geometry
+    double textureLoadMs = 0.0;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    // the final meshes are also written to a binary cache next to the model, which later runs map instead of running ASSIMP.
+    void loadModel(string const &path, MeshCache &cache, bool keepCpuGeometry)
     {
+        auto start = std::chrono::steady_clock::now();
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        unsigned int flags = importFlags;
+        if (!vertexFormat.Has(ATTRIB_TANGENT) && !vertexFormat.Has(ATTRIB_BITANGENT))
+            flags &= ~aiProcess_CalcTangentSpace;
+        uint32_t pipelineFlags = optimizeMeshes ? MESH_CACHE_OPTIMIZED : 0;
+
+        // the cache is keyed on the contents of the model file and its materials, not their timestamps
+        uint64_t sourceHash = MeshCache::SourceHash(path);
+        string cachePath = MeshCache::PathFor(path);
+        if (sourceHash != 0 && cache.Open(cachePath, sourceHash, flags, pipelineFlags))
+        {
+            loadFromCache(cache, keepCpuGeometry);
+            double warmMs = elapsedMs(start) - textureLoadMs;
+            cout << "MODEL::LOAD " << path << ": warm " << warmMs << " ms (cold " << cache.ColdLoadMs() << " ms, "
+                 << cache.ColdLoadMs() / std::max(warmMs, 0.001) << "x), textures " << textureLoadMs << " ms" << endl;
+            return;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, flags);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
+        meshes.reserve(scene->mNumMeshes);
         processNode(scene->mRootNode, scene);
+
+        double coldMs = elapsedMs(start) - textureLoadMs;
+        bool written = sourceHash != 0 && MeshCache::Write(cachePath, sourceHash, flags, pipelineFlags, meshes, coldMs);
+        cout << "MODEL::LOAD " << path << ": cold " << coldMs << " ms, textures " << textureLoadMs << " ms"
+             << (written ? ", cache written to " + cachePath : ", cache not written") << endl;
+        if (optimizeMeshes)
+            reportOptimization("MESH::OPTIMIZE " + path + " total", optimizeTotals);
+    }
+
+    // rebuilds the meshes from a mapped cache file, the vertex and index ranges are used as they are; they are
+    // only copied when the meshes keep their CPU geometry
+    void loadFromCache(const MeshCache &cache, bool keepCpuGeometry)
+    {
+        meshes.reserve(cache.MeshCount());
+        for (uint32_t i = 0; i < cache.MeshCount(); i++)
+        {
+            const MeshCacheEntry &entry = cache.Entry(i);
+            vector<Texture> textures;
+            textures.reserve(entry.textureCount);
+            for (uint32_t t = entry.firstTexture; t < entry.firstTexture + entry.textureCount; t++)
+                textures.push_back(loadTexture(cache.TexturePath(t), TextureTypeFromName(cache.TextureType(t))));
+            if (keepCpuGeometry)
+                meshes.emplace_back(vector<Vertex>(cache.Vertices(i), cache.Vertices(i) + entry.vertexCount),
+                                    vector<unsigned int>(cache.Indices(i), cache.Indices(i) + entry.indexCount),
+                                    std::move(textures), vertexFormat, !packed && !lightmap);
+            else
+                meshes.emplace_back(cache.Vertices(i), entry.vertexCount, cache.Indices(i), entry.indexCount,
+                                    std::move(textures), vertexFormat, !packed && !lightmap);
+        }
+    }
+
+    // a mesh's geometry while the model is built: its own copy, or the cache range it was made from
+    const Vertex *sourceVertices(const MeshCache &cache, unsigned int mesh) const
+    {
+        return meshes[mesh].vertices.empty() && cache.IsOpen() ? cache.Vertices(mesh) : meshes[mesh].vertices.data();
+    }
+    const unsigned int *sourceIndices(const MeshCache &cache, unsigned int mesh) const
+    {
+        return meshes[mesh].indices.empty() && cache.IsOpen() ? cache.Indices(mesh) : meshes[mesh].indices.data();
+    }
+
+    // packs every mesh into one vertex and one index buffer; the meshes only keep their ranges in them.
+    // The layout and index type are chosen for the whole model, so one VAO describes all of it.
+    void packGeometry(const MeshCache &cache)
+    {
+        bool texCoordsFit = true, shortIndices = true;
+        size_t vertexTotal = 0, indexTotal = 0;
+        for (unsigned int m = 0; m < meshes.size(); m++)
+        {
+            const Mesh &mesh = meshes[m];
+            texCoordsFit = texCoordsFit && VertexLayout::FitsShortTexCoords(sourceVertices(cache, m), mesh.vertexCount);
+            shortIndices = shortIndices && mesh.vertexCount <= 65536;
+            vertexTotal += mesh.vertexCount;
+            indexTotal += mesh.indexCount;
+        }
+        VertexLayout layout(vertexFormat, texCoordsFit);
+        GLenum indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        size_t indexSize = shortIndices ? sizeof(uint16_t) : sizeof(unsigned int);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        vector<unsigned char> vertexData(vertexTotal * layout.stride);
+        vector<unsigned char> indexData(indexTotal * indexSize);
+        size_t firstVertex = 0, firstIndex = 0;
+        for (unsigned int m = 0; m < meshes.size(); m++)
+        {
+            Mesh &mesh = meshes[m];
+            const unsigned int *indices = sourceIndices(cache, m);
+            layout.Pack(sourceVertices(cache, m), mesh.vertexCount, &vertexData[firstVertex * layout.stride]);
+            // indices stay relative to the mesh, the base vertex moves them to its range
+            for (size_t i = 0; i < mesh.indexCount; i++)
+            {
+                if (shortIndices)
+                    ((uint16_t *)indexData.data())[firstIndex + i] = (uint16_t)indices[i];
+                else
+                    ((unsigned int *)indexData.data())[firstIndex + i] = indices[i];
+            }
+            mesh.UsePackedRange(VAO, layout.stride, indexType, firstIndex * indexSize, (int)firstVertex);
+            firstVertex += mesh.vertexCount;
+            firstIndex += mesh.indexCount;
+        }
+
+        GLState::Get().BindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size(), indexData.data(), GL_STATIC_DRAW);
+        layout.SetAttributes();
+    }
+
+    // the mesh cache keeps the geometry as imported, the lightmap's seams are applied on top of it every load
+    void applyLightmap(const string &path, const MeshCache &cache)
+    {
+        unsigned int applied = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            vector<Vertex> vertices;
+            vector<unsigned int> indices;
+            if (lightmap->MeshGeometry(i, sourceVertices(cache, i), mesh.vertexCount, sourceIndices(cache, i),
+                                       mesh.indexCount, vertices, indices))
+            {
+                mesh.ReplaceGeometry(std::move(vertices), std::move(indices));
+                applied++;
+            }
+            if (!packed)
+                mesh.Upload(vertexFormat, sourceVertices(cache, i), sourceIndices(cache, i));
+        }
+        cout << "LIGHTMAP::APPLY " << path << ": " << applied << " of " << meshes.size() << " meshes"
+             << (applied < meshes.size() ? ", the others changed since the bake and stay unbaked" : "") << endl;
+    }
+
+    static ModelOptions gammaOnly(bool gamma)
+    {
+        ModelOptions options;
+        options.gamma = gamma;
+        return options;
+    }
+
+    // how much less vertex data the chosen format streams than the full float Vertex
+    void reportVertexBandwidth(const string &path) const
+    {
+        size_t vertexCount = 0, uploadedBytes = 0;
+        for (const Mesh &mesh : meshes)
+        {
+            vertexCount += mesh.vertexCount;
+            uploadedBytes += (size_t)mesh.vertexCount * mesh.vertexStride;
+        }
+        size_t fullBytes = vertexCount * sizeof(Vertex);
+        if (vertexCount == 0)
+            return;
+        cout << "MODEL::VERTEX " << path << ": " << vertexCount << " vertices, " << sizeof(Vertex) << " -> "
+             << (double)uploadedBytes / vertexCount << " bytes each, " << fullBytes / (1024.0 * 1024.0) << " MB -> "
+             << uploadedBytes / (1024.0 * 1024.0) << " MB fetched per draw (" << 100.0 * (fullBytes - uploadedBytes) / fullBytes
+             << "% saved)" << endl;
+    }
+
+    static void reportOptimization(const string &what, const MeshOptimizeStats &stats)
+    {
+        cout << what << ": vertices " << stats.verticesBefore << " -> " << stats.verticesAfter
+             << ", ACMR " << stats.before.Acmr() << " -> " << stats.after.Acmr()
+             << ", ATVR " << stats.before.Atvr() << " -> " << stats.after.Atvr()
+             << ", " << stats.bytesBefore / 1024.0 << " KB -> " << stats.bytesAfter / 1024.0 << " KB" << endl;
+    }
+
+    static double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -81,7 +326,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshes.push_back(processMesh(mesh, scene));  // moved, not copied
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -97,6 +342,16 @@ private:
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        // sized up front so the loops below never reallocate
+        vertices.reserve(mesh->mNumVertices);
+        unsigned int indexCount = 0;
+        bool trianglesOnly = true;
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+        {
+            indexCount += mesh->mFaces[i].mNumIndices;
+            trianglesOnly = trianglesOnly && mesh->mFaces[i].mNumIndices == 3;
+        }
+        indices.reserve(indexCount);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -125,6 +380,12 @@ private:
                 vec.x = mesh->mTextureCoords[0][i].x;
                 vec.y = mesh->mTextureCoords[0][i].y;
                 vertex.TexCoords = vec;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            // tangent space, only imported when the vertex format uses it
+            if (mesh->mTangents && mesh->mBitangents)
+            {
                 // tangent
                 vector.x = mesh->mTangents[i].x;
                 vector.y = mesh->mTangents[i].y;
@@ -137,7 +398,9 @@ private:
                 vertex.Bitangent = vector;
             }
             else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+                vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+            // set by the lightmap after loading, if there is one
+            vertex.LightmapCoords = glm::vec2(0.0f);
 
             vertices.push_back(vertex);
 
@@ -146,11 +409,20 @@ private:
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+        // the optimizer reorders whole triangles, meshes with leftover points or lines stay as imported
+        if (optimizeMeshes && trianglesOnly && !indices.empty())
+        {
+            VertexLayout layout(vertexFormat, VertexLayout::FitsShortTexCoords(vertices));
+            MeshOptimizeStats stats = OptimizeMesh(vertices, indices, layout.stride);
+            reportOptimization("MESH::OPTIMIZE " + string(mesh->mName.C_Str()), stats);
+            optimizeTotals.Add(stats);
+        }
+
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -164,96 +436,60 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, TEXTURE_DIFFUSE);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, TEXTURE_SPECULAR);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, TEXTURE_NORMAL);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, TEXTURE_HEIGHT);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
 
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures), vertexFormat, !packed && !lightmap);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType textureType)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), textureType));
         }
         return textures;
     }
+
+    // returns the texture at the given path; the TextureCache loads each file only once for the whole process
+    Texture loadTexture(const string &path, TextureType type)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Texture texture;
+        texture.id = TextureCache::Instance().Acquire(this->directory + '/' + path, gammaCorrection);
+        texture.type = type;
+        texture.path = path;
+        textureReferences.push_back(texture.id);
+        textureLoadMs += elapsedMs(start);
+        return texture;
+    }
 };
 
 
+// queues the texture on the TextureLoader; the returned name is valid right away but only holds the image
+// after TextureLoader::Instance().Process()/Finish() has run on the GL thread.
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureLoader::Instance().Load(filename, gamma);
 }
 #endif
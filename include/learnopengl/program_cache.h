@@ -0,0 +1,164 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <sys/stat.h>
+
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/hash.h>
+#include <learnopengl/mapped_file.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Linked shader programs saved with glGetProgramBinary, one file per program in shader_cache/:
+//
+//   ProgramCacheHeader
+//   unsigned char binary[binaryLength]
+//
+// The file name is the key, a hash of the program's sources and of GL_VENDOR, GL_RENDERER and GL_VERSION,
+// so editing a shader or updating the driver simply misses. The driver may still refuse a binary it wrote
+// itself (it is free to after any change it cares about); then the file is deleted and the program compiled.
+const uint32_t PROGRAM_CACHE_MAGIC = 0x47525050; // "PPRG"
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+    double compileMs;       // compile and link time of the run that wrote the binary
+};
+
+class ProgramCache
+{
+public:
+    static const char *Directory() { return "shader_cache"; }
+
+    static bool Available()
+    {
+        const GLExtensions &gl = GLExtensions::Get();
+        return gl.GetProgramBinary && gl.ProgramBinary && gl.ProgramParameteri;
+    }
+
+    // key of a program built from these sources by the current driver
+    static uint64_t Key(const std::vector<std::string> &sources)
+    {
+        uint64_t hash = driverHash();
+        for (const std::string &source : sources)
+        {
+            uint64_t size = source.size();
+            hash = HashBytes(&size, sizeof(size), hash);
+            hash = HashBytes(source.data(), source.size(), hash);
+        }
+        return hash;
+    }
+
+    static std::string PathFor(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return std::string(Directory()) + "/" + name;
+    }
+
+    // loads the binary into an unlinked program; false on a miss or when the driver rejects it
+    static bool Load(GLuint program, uint64_t key, double &compileMs)
+    {
+        if (!Available())
+            return false;
+        std::string path = PathFor(key);
+        MappedFile file;
+        if (!file.Open(path))
+            return false;
+        const ProgramCacheHeader *header = reinterpret_cast<const ProgramCacheHeader *>(file.data);
+        if (file.size < sizeof(ProgramCacheHeader) || header->magic != PROGRAM_CACHE_MAGIC ||
+            header->version != PROGRAM_CACHE_VERSION || header->key != key ||
+            sizeof(ProgramCacheHeader) + (uint64_t)header->binaryLength > file.size)
+            return reject(path);
+        GLExtensions::Get().ProgramBinary(program, header->binaryFormat, file.data + sizeof(ProgramCacheHeader),
+                                          header->binaryLength);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+            return reject(path);
+        compileMs = header->compileMs;
+        return true;
+    }
+
+    // asks the driver to keep the binary retrievable, call before glLinkProgram
+    static void PrepareLink(GLuint program)
+    {
+        if (Available())
+            GLExtensions::Get().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes a linked program; goes through a temporary file so a crash never leaves a torn binary behind
+    static bool Store(GLuint program, uint64_t key, double compileMs)
+    {
+        if (!Available())
+            return false;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        GLExtensions::Get().GetProgramBinary(program, length, &written, &format, binary.data());
+        if (written <= 0)
+            return false;
+
+        ProgramCacheHeader header = {};
+        header.magic = PROGRAM_CACHE_MAGIC;
+        header.version = PROGRAM_CACHE_VERSION;
+        header.key = key;
+        header.binaryFormat = format;
+        header.binaryLength = written;
+        header.compileMs = compileMs;
+
+        mkdir(Directory(), 0755);
+        std::string path = PathFor(key);
+        std::string tmpPath = path + ".tmp";
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(binary.data(), written);
+        out.close();
+        if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static uint64_t driverHash()
+    {
+        static uint64_t hash = 0;
+        if (hash == 0)
+        {
+            hash = HashString("program cache");
+            for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+            {
+                const char *value = (const char *)glGetString(name);
+                if (value)
+                    hash = HashBytes(value, strlen(value) + 1, hash);
+            }
+        }
+        return hash;
+    }
+
+    static bool reject(const std::string &path)
+    {
+        std::remove(path.c_str());
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,236 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frame_arena.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/hash.h>
+#include <learnopengl/model.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+enum RenderPass {
+    RENDER_PASS_GBUFFER = 0,
+    RENDER_PASS_TRANSPARENT,
+    RENDER_PASS_COUNT
+};
+
+// blended passes are drawn back to front, the others front to back
+inline bool RenderPassBlended(RenderPass pass)
+{
+    return pass == RENDER_PASS_TRANSPARENT;
+}
+
+// One recorded draw: a mesh with its material, or a callback for what isn't a single mesh (an indirect
+// multi-draw). Everything it points to has to outlive the frame's Submit().
+struct DrawCommand {
+    Shader *shader;
+    const glm::mat4 *transform;   // set as "model" when it differs from the previous command's
+    unsigned int vertexArray;
+    Mesh *mesh;
+    void (*draw)(void *context, Shader &shader);
+    void *context;
+};
+
+// Draws are pushed into one bucket per pass instead of being issued in the order the scene code walks the
+// models. Each gets a 64-bit key, Submit() radix sorts the bucket by it and issues the commands in that
+// order, switching program, "model" and textures only when the next command needs something else.
+//   opaque:  pass:4 | program:12 | material:24 | depth:24       (state changes first, then front to back)
+//   blended: pass:4 | far depth:24 | program:12 | material:24   (back to front, correctness before state)
+// Commands, keys and transforms live in the frame's FrameArena, so recording doesn't allocate; Begin() has
+// to come after the arena's Reset() and Submit() before the next one.
+class RenderQueue
+{
+public:
+    struct PassStats {
+        unsigned int commands = 0;
+        unsigned int draws = 0;
+        unsigned int binds = 0;           // vertex array and texture binds that reached GL
+        unsigned int programSwitches = 0;
+    };
+
+    explicit RenderQueue(FrameArena &arena) : arena(arena) {}
+    RenderQueue(const RenderQueue &) = delete;
+    RenderQueue &operator=(const RenderQueue &) = delete;
+
+    // starts a frame; the view matrix and clip range are what the depth part of the keys is measured in
+    void Begin(const glm::mat4 &view, float nearPlane, float farPlane)
+    {
+        this->view = view;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        for (Bucket &bucket : buckets)
+        {
+            // sized for what the pass recorded last frame, so it rarely has to grow
+            bucket.capacity = std::max(bucket.count, 64u);
+            bucket.commands = arena.Allocate<DrawCommand>(bucket.capacity);
+            bucket.keys = arena.Allocate<SortEntry>(bucket.capacity);
+            bucket.count = 0;
+        }
+    }
+
+    // a copy of the matrix that stays valid until the arena is reset
+    const glm::mat4 *Transform(const glm::mat4 &matrix)
+    {
+        glm::mat4 *copy = arena.Allocate<glm::mat4>(1);
+        *copy = matrix;
+        return copy;
+    }
+
+    void Push(RenderPass pass, Shader &shader, Mesh &mesh, const glm::mat4 *transform)
+    {
+        uint64_t materialKey = 0;
+        for (const Texture &texture : mesh.textures)
+            materialKey = HashBytes(&texture.id, sizeof(texture.id), materialKey);
+        float depth = Depth(*transform, (mesh.boundsMin + mesh.boundsMax) * 0.5f);
+        push(pass, key(pass, shader.ID, (uint32_t)materialKey, depth), {&shader, transform, mesh.VAO, &mesh, nullptr, nullptr});
+    }
+
+    void Push(RenderPass pass, Shader &shader, Model &model, const glm::mat4 *transform)
+    {
+        for (Mesh &mesh : model.meshes)
+            Push(pass, shader, mesh, transform);
+    }
+
+    // a draw done by callback; materialKey groups it with the commands that use the same textures
+    void Push(RenderPass pass, Shader &shader, const glm::mat4 *transform, unsigned int vertexArray,
+              uint32_t materialKey, float depth, void (*draw)(void *context, Shader &shader), void *context)
+    {
+        push(pass, key(pass, shader.ID, materialKey, depth), {&shader, transform, vertexArray, nullptr, draw, context});
+    }
+
+    // view space distance of a point, 0 at the near plane and 1 at the far one
+    float Depth(const glm::mat4 &transform, const glm::vec3 &point) const
+    {
+        float distance = -(view * transform * glm::vec4(point, 1.0f)).z;
+        return std::min(std::max((distance - nearPlane) / (farPlane - nearPlane), 0.0f), 1.0f);
+    }
+
+    // sorts the pass's bucket and draws it; the caller has bound the pass's framebuffer and set its state
+    void Submit(RenderPass pass)
+    {
+        Bucket &bucket = buckets[pass];
+        RenderStats &frame = RenderStats::Frame();
+        unsigned int draws = frame.drawCalls, binds = frame.vertexArrayBinds + frame.textureBinds;
+        PassStats &passStats = stats[pass];
+        passStats = PassStats();
+        passStats.commands = bucket.count;
+
+        SortEntry *scratch = arena.Allocate<SortEntry>(bucket.count);
+        radixSort(bucket.keys, scratch, bucket.count);
+
+        Shader *shader = nullptr;
+        const glm::mat4 *transform = nullptr;
+        for (unsigned int i = 0; i < bucket.count; i++)
+        {
+            DrawCommand &command = bucket.commands[bucket.keys[i].command];
+            if (command.shader != shader)
+            {
+                shader = command.shader;
+                shader->use();
+                passStats.programSwitches++;
+                transform = nullptr;
+            }
+            if (command.transform != transform)
+            {
+                transform = command.transform;
+                shader->setMat4("model", *transform);
+            }
+            GLState::Get().BindVertexArray(command.vertexArray);
+            if (command.mesh)
+                command.mesh->Draw(*shader);
+            else
+                command.draw(command.context, *shader);
+        }
+        passStats.draws = frame.drawCalls - draws;
+        passStats.binds = frame.vertexArrayBinds + frame.textureBinds - binds;
+    }
+
+    // of the last Submit() of the pass
+    const PassStats &Stats(RenderPass pass) const { return stats[pass]; }
+    const FrameArena &Arena() const { return arena; }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        unsigned int command;   // index into the bucket's commands
+    };
+    struct Bucket {
+        DrawCommand *commands = nullptr;
+        SortEntry *keys = nullptr;
+        unsigned int count = 0, capacity = 0;
+    };
+
+    FrameArena &arena;
+    Bucket buckets[RENDER_PASS_COUNT];
+    PassStats stats[RENDER_PASS_COUNT];
+    glm::mat4 view = glm::mat4(1.0f);
+    float nearPlane = 0.1f, farPlane = 100.0f;
+
+    static uint64_t key(RenderPass pass, unsigned int program, uint32_t material, float depth)
+    {
+        const uint64_t DEPTH_MAX = 0xFFFFFF;
+        uint64_t key = (uint64_t)pass << 60;
+        uint64_t programBits = program & 0xFFF, materialBits = material & 0xFFFFFF;
+        if (RenderPassBlended(pass))
+        {
+            uint64_t farDepth = DEPTH_MAX - (uint64_t)(depth * DEPTH_MAX);
+            return key | farDepth << 36 | programBits << 24 | materialBits;
+        }
+        return key | programBits << 48 | materialBits << 24 | (uint64_t)(depth * DEPTH_MAX);
+    }
+
+    void push(RenderPass pass, uint64_t key, const DrawCommand &command)
+    {
+        Bucket &bucket = buckets[pass];
+        if (bucket.count == bucket.capacity)
+        {
+            // the old arrays stay in the arena until it is reset
+            unsigned int capacity = bucket.capacity * 2;
+            DrawCommand *commands = arena.Allocate<DrawCommand>(capacity);
+            SortEntry *keys = arena.Allocate<SortEntry>(capacity);
+            std::memcpy(commands, bucket.commands, bucket.count * sizeof(DrawCommand));
+            std::memcpy(keys, bucket.keys, bucket.count * sizeof(SortEntry));
+            bucket.commands = commands;
+            bucket.keys = keys;
+            bucket.capacity = capacity;
+        }
+        bucket.commands[bucket.count] = command;
+        bucket.keys[bucket.count] = {key, bucket.count};
+        bucket.count++;
+    }
+
+    // LSD radix sort on the key, a byte per pass; bytes that are equal in every key are skipped, which in
+    // practice leaves the program byte, a few material bytes and the depth
+    static void radixSort(SortEntry *entries, SortEntry *scratch, unsigned int count)
+    {
+        SortEntry *source = entries, *target = scratch;
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            unsigned int histogram[256] = {};
+            for (unsigned int i = 0; i < count; i++)
+                histogram[(source[i].key >> shift) & 0xFF]++;
+            if (count == 0 || histogram[(source[0].key >> shift) & 0xFF] == count)
+                continue;
+            unsigned int offset = 0;
+            for (unsigned int &bin : histogram)
+            {
+                unsigned int size = bin;
+                bin = offset;
+                offset += size;
+            }
+            for (unsigned int i = 0; i < count; i++)
+                target[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+            std::swap(source, target);
+        }
+        if (source != entries)
+            std::memcpy(entries, source, count * sizeof(SortEntry));
+    }
+};
+#endif
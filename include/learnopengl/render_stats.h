@@ -0,0 +1,45 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+// Per frame counters of the GL calls that cost CPU time in the driver. The code that draws or binds counts
+// itself in Frame(); the render loop calls NextFrame() once per frame and shows LastFrame().
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    unsigned int vertexArrayBinds = 0;
+    unsigned int textureBinds = 0;
+    unsigned int textureBindsSkipped = 0;   // the unit already held the texture
+    // calls that went through GLState, and those it dropped because they changed nothing
+    unsigned int stateCalls = 0;
+    unsigned int stateCallsFiltered = 0;
+    // sampler names the precomputed Material bindings no longer build and look up per draw
+    unsigned int locationQueriesSaved = 0;
+    // operator new and ImGui allocations, counted by HeapCounter over the whole frame
+    unsigned int heapAllocations = 0;
+    // CPU time spent in glClientWaitSync on the persistently mapped buffers
+    double fenceWaitMs = 0.0;
+
+    static RenderStats &Frame()
+    {
+        static RenderStats current;
+        return current;
+    }
+
+    static const RenderStats &LastFrame()
+    {
+        return last();
+    }
+
+    static void NextFrame()
+    {
+        last() = Frame();
+        Frame() = RenderStats();
+    }
+
+private:
+    static RenderStats &last()
+    {
+        static RenderStats previous;
+        return previous;
+    }
+};
+#endif
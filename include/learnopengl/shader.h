@@ -4,171 +4,479 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <learnopengl/gl_state.h>
+#include <learnopengl/hash.h>
+#include <learnopengl/program_cache.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 #include <common.h>
+
+// typed handle to a uniform, looked up once by name and then set without any string work.
+// It refers to a slot in its Shader, so it stays valid when the program is linked again.
+template <typename T>
+struct Uniform {
+    int slot = -1;
+};
+
 class Shader
 {
 public:
-    unsigned int ID;
-    // constructor generates the shader on the fly
+    unsigned int ID = 0;
+    // constructor generates the shader on the fly. Without wait the program is only submitted: the driver
+    // compiles it in the background (GL_KHR_parallel_shader_compile) and Poll() or Finish() swap it in
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, bool wait = true)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath ? geometryPath : "")
+    {
+        start(wait, "");
+    }
+    // a permutation of the sources: every entry becomes a "#define <entry>" line right after #version
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines, bool wait = true)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath)
     {
-        std::string vertexPathString(vertexPath);
-        std::string fragmentPathString(fragmentPath);
+        start(wait, setDefines(defines));
+    }
+    // a compute program: Shader(Shader::Compute(), "culling.comp"), built, cached and reloaded like the others
+    struct Compute {};
+    Shader(Compute, const char* computePath, const std::vector<std::string> &defines = {}, bool wait = true)
+        : computePath(computePath)
+    {
+        start(wait, setDefines(defines));
+    }
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
 
-        vertexPath = vertexPathString.c_str();
-        fragmentPath= fragmentPathString.c_str();
+    // reads the sources again and starts building a new program from them; ID stays the old program until
+    // the new one has linked, a program that fails to compile or link is dropped and the old one kept
+    void Submit()
+    {
+        discardPending();
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+        std::string computeCode;
+        sourceTime = modifiedTime();
+        bool compute = !computePath.empty();
+        if (compute ? !readFile(computePath, computeCode) :
+            !readFile(vertexPath, vertexCode) || !readFile(fragmentPath, fragmentCode) ||
+            (!geometryPath.empty() && !readFile(geometryPath, geometryCode)))
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            return;
+        }
+        injectDefines(vertexCode);
+        injectDefines(fragmentCode);
+        injectDefines(geometryCode);
+        injectDefines(computeCode);
+        // 2. reuse the program an earlier run linked from the same sources, if the driver still takes it
+        pendingKey = compute ? ProgramCache::Key({computeCode}) : ProgramCache::Key({vertexCode, fragmentCode, geometryCode});
+        pendingStart = std::chrono::steady_clock::now();
+        pendingID = glCreateProgram();
+        pendingCompileMs = 0.0;
+        pendingCompleted = false;
+        pendingCached = ProgramCache::Load(pendingID, pendingKey, pendingCompileMs);
+        if (pendingCached)
+        {
+            pendingSubmitMs = sinceSubmit();
+            return;
+        }
+        // 3. compile shaders, nothing here waits for the compiler
+        if (compute)
+        {
+            const char *cShaderCode = computeCode.c_str();
+            pendingShaders[0] = glCreateShader(GL_COMPUTE_SHADER);
+            glShaderSource(pendingShaders[0], 1, &cShaderCode, NULL);
+            glCompileShader(pendingShaders[0]);
+            glAttachShader(pendingID, pendingShaders[0]);
+            ProgramCache::PrepareLink(pendingID);
+            glLinkProgram(pendingID);
+            pendingSubmitMs = sinceSubmit();
+            return;
         }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
         // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        pendingShaders[0] = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pendingShaders[0], 1, &vShaderCode, NULL);
+        glCompileShader(pendingShaders[0]);
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        pendingShaders[1] = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pendingShaders[1], 1, &fShaderCode, NULL);
+        glCompileShader(pendingShaders[1]);
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+        if(!geometryPath.empty())
         {
             const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            pendingShaders[2] = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(pendingShaders[2], 1, &gShaderCode, NULL);
+            glCompileShader(pendingShaders[2]);
         }
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        for (unsigned int shader : pendingShaders)
+            if (shader)
+                glAttachShader(pendingID, shader);
+        ProgramCache::PrepareLink(pendingID);
+        glLinkProgram(pendingID);
+        pendingSubmitMs = sinceSubmit();
+    }
+
+    bool Pending() const { return pendingID != 0; }
+
+    // true once the submitted program can be finished without waiting for the driver
+    bool Ready() const
+    {
+        if (!pendingID)
+            return false;
+        if (pendingCached || !GLExtensions::Get().parallelShaderCompile)
+            return true;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(pendingID, GL_COMPLETION_STATUS_KHR, &complete);
+        // the build time ends here, not whenever the caller gets around to Finish()
+        if (complete == GL_TRUE && !pendingCompleted)
+        {
+            pendingCompleted = true;
+            pendingCompletedMs = sinceSubmit();
+        }
+        return complete == GL_TRUE;
+    }
+
+    // swaps the submitted program in when it is ready; true when ID changed
+    bool Poll()
+    {
+        return Ready() && Finish();
+    }
+
+    // waits for the submitted program and swaps it in if it linked; true when ID changed
+    bool Finish()
+    {
+        if (!pendingID)
+            return false;
+        // seen complete by Ready(), or built on this thread: the calls in Submit() and the wait for the link status
+        auto waitStart = std::chrono::steady_clock::now();
+        GLint linked = GL_FALSE;
+        glGetProgramiv(pendingID, GL_LINK_STATUS, &linked);
+        double elapsedMs = pendingCompleted ? pendingCompletedMs :
+            pendingSubmitMs + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+        if (!pendingCached)
+        {
+            checkCompileErrors(pendingShaders[0], computePath.empty() ? "VERTEX" : "COMPUTE");
+            if (pendingShaders[1])
+                checkCompileErrors(pendingShaders[1], "FRAGMENT");
+            if (pendingShaders[2])
+                checkCompileErrors(pendingShaders[2], "GEOMETRY");
+            checkCompileErrors(pendingID, "PROGRAM");
+        }
+        if (!linked)
+        {
+            std::cout << "SHADER::PROGRAM " << name << ": build failed"
+                      << (ID ? ", keeping the previous program" : "") << std::endl;
+            discardPending();
+            return false;
+        }
+        if (pendingCached)
+            std::cout << "SHADER::PROGRAM " << name << ": binary cache hit in " << elapsedMs
+                      << " ms (compiling took " << pendingCompileMs << " ms)" << std::endl;
+        else
+        {
+            bool cached = ProgramCache::Store(pendingID, pendingKey, elapsedMs);
+            std::cout << "SHADER::PROGRAM " << name << ": compiled and linked in " << elapsedMs << " ms"
+                      << (cached ? ", binary cached" : "") << std::endl;
+        }
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
+        deleteShaders();
+        if (ID)
+            GLState::Get().DeleteProgram(ID);
+        ID = pendingID;
+        pendingID = 0;
+        reflectUniforms();
+        return true;
+    }
 
+    // true when one of the source files was saved since the last Submit()
+    bool SourcesChanged() const
+    {
+        return modifiedTime() != sourceTime;
     }
+
+    const std::string &Name() const { return name; }
+
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLState::Get().UseProgram(ID);
     }
-    // utility uniform functions
+    // utility uniform functions, string literals pick the const char * overloads and build no std::string
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
-    {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    void setBool(const char *name, bool value) const
+    {
+        glUniform1i(glGetUniformLocation(ID, name), (int)value);
     }
+    void setBool(const std::string &name, bool value) const { setBool(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
-    { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    void setInt(const char *name, int value) const
+    {
+        glUniform1i(glGetUniformLocation(ID, name), value);
     }
+    void setInt(const std::string &name, int value) const { setInt(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
-    { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    void setFloat(const char *name, float value) const
+    {
+        glUniform1f(glGetUniformLocation(ID, name), value);
     }
+    void setFloat(const std::string &name, float value) const { setFloat(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
-    { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    void setVec2(const char *name, const glm::vec2 &value) const
+    {
+        glUniform2fv(glGetUniformLocation(ID, name), 1, &value[0]);
     }
-    void setVec2(const std::string &name, float x, float y) const
-    { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+    void setVec2(const std::string &name, const glm::vec2 &value) const { setVec2(name.c_str(), value); }
+    void setVec2(const char *name, float x, float y) const
+    {
+        glUniform2f(glGetUniformLocation(ID, name), x, y);
     }
+    void setVec2(const std::string &name, float x, float y) const { setVec2(name.c_str(), x, y); }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
-    { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    void setVec3(const char *name, const glm::vec3 &value) const
+    {
+        glUniform3fv(glGetUniformLocation(ID, name), 1, &value[0]);
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
-    { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+    void setVec3(const std::string &name, const glm::vec3 &value) const { setVec3(name.c_str(), value); }
+    void setVec3(const char *name, float x, float y, float z) const
+    {
+        glUniform3f(glGetUniformLocation(ID, name), x, y, z);
     }
+    void setVec3(const std::string &name, float x, float y, float z) const { setVec3(name.c_str(), x, y, z); }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
-    { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    void setVec4(const char *name, const glm::vec4 &value) const
+    {
+        glUniform4fv(glGetUniformLocation(ID, name), 1, &value[0]);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
-    { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+    void setVec4(const std::string &name, const glm::vec4 &value) const { setVec4(name.c_str(), value); }
+    void setVec4(const char *name, float x, float y, float z, float w)
+    {
+        glUniform4f(glGetUniformLocation(ID, name), x, y, z, w);
     }
+    void setVec4(const std::string &name, float x, float y, float z, float w) { setVec4(name.c_str(), x, y, z, w); }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(const char *name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat2(const std::string &name, const glm::mat2 &mat) const { setMat2(name.c_str(), mat); }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(const char *name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat3(const std::string &name, const glm::mat3 &mat) const { setMat3(name.c_str(), mat); }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(const char *name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat4(const std::string &name, const glm::mat4 &mat) const { setMat4(name.c_str(), mat); }
+
+    // handles to uniforms: resolve them once (for struct arrays: "lights[3].position") and keep them around
+    // ------------------------------------------------------------------------
+    template <typename T>
+    Uniform<T> uniform(const std::string &name)
+    {
+        Uniform<T> handle;
+        handle.slot = slotFor(HashString(name.c_str()));
+        return handle;
+    }
+    // a handle this shader never resolved (default constructed, or another shader's) sets nothing
+    void set(Uniform<bool> u, bool value) const { glUniform1i(slotLocation(u.slot), (int)value); }
+    void set(Uniform<int> u, int value) const { glUniform1i(slotLocation(u.slot), value); }
+    void set(Uniform<float> u, float value) const { glUniform1f(slotLocation(u.slot), value); }
+    void set(Uniform<glm::vec2> u, const glm::vec2 &value) const { glUniform2fv(slotLocation(u.slot), 1, &value[0]); }
+    void set(Uniform<glm::vec3> u, const glm::vec3 &value) const { glUniform3fv(slotLocation(u.slot), 1, &value[0]); }
+    void set(Uniform<glm::vec4> u, const glm::vec4 &value) const { glUniform4fv(slotLocation(u.slot), 1, &value[0]); }
+    void set(Uniform<glm::mat3> u, const glm::mat3 &mat) const { glUniformMatrix3fv(slotLocation(u.slot), 1, GL_FALSE, &mat[0][0]); }
+    void set(Uniform<glm::mat4> u, const glm::mat4 &mat) const { glUniformMatrix4fv(slotLocation(u.slot), 1, GL_FALSE, &mat[0][0]); }
+
+    // location of any active uniform by name hash, -1 when the program doesn't use it
+    GLint location(uint64_t nameHash) const
+    {
+        auto it = locations.find(nameHash);
+        return it == locations.end() ? -1 : it->second;
+    }
+    size_t ActiveUniformCount() const { return locations.size(); }
 
 private:
+    std::string vertexPath, fragmentPath, geometryPath, computePath;
+    std::string name;
+    std::string defines;
+    long long sourceTime = 0;
+    // the program being built, ID is swapped for it once it links
+    unsigned int pendingID = 0;
+    unsigned int pendingShaders[3] = {0, 0, 0};
+    uint64_t pendingKey = 0;
+    bool pendingCached = false;
+    double pendingCompileMs = 0.0;
+    std::chrono::steady_clock::time_point pendingStart;
+    // how long Submit() took, and when Ready() first saw the background build complete
+    double pendingSubmitMs = 0.0;
+    mutable double pendingCompletedMs = 0.0;
+    mutable bool pendingCompleted = false;
+
+    struct UniformSlot {
+        uint64_t nameHash;
+        GLint location;
+    };
+    // every active uniform of the linked program, array elements listed one by one
+    std::unordered_map<uint64_t, GLint> locations;
+    std::vector<UniformSlot> slots;
+
+    // -1 makes the glUniform call a no-op
+    GLint slotLocation(int slot) const
+    {
+        return slot >= 0 && slot < (int)slots.size() ? slots[slot].location : -1;
+    }
+
+    int slotFor(uint64_t nameHash)
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+            if (slots[i].nameHash == nameHash)
+                return i;
+        slots.push_back({nameHash, location(nameHash)});
+        return slots.size() - 1;
+    }
+
+    // reads the active uniforms after a link and points the existing handles at their new locations
+    void reflectUniforms()
+    {
+        locations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> name(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type;
+            GLsizei length = 0;
+            glGetActiveUniform(ID, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            std::string uniformName(name.data(), length);
+            // arrays of basic types are reported once as "name[0]", with their size
+            size_t bracket = uniformName.size() >= 3 ? uniformName.rfind("[0]") : std::string::npos;
+            if (size > 1 && bracket == uniformName.size() - 3)
+            {
+                std::string base = uniformName.substr(0, bracket);
+                locations[HashString(base.c_str())] = glGetUniformLocation(ID, uniformName.c_str());
+                for (GLint element = 0; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    locations[HashString(elementName.c_str())] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+            else
+                locations[HashString(uniformName.c_str())] = glGetUniformLocation(ID, uniformName.c_str());
+        }
+        for (UniformSlot &slot : slots)
+            slot.location = location(slot.nameHash);
+    }
+
+    // returns the variant's suffix for the name
+    std::string setDefines(const std::vector<std::string> &defines)
+    {
+        std::string names;
+        for (const std::string &define : defines)
+        {
+            this->defines += "#define " + define + "\n";
+            names += (names.empty() ? "" : " ") + define.substr(0, define.find(' '));
+        }
+        return names.empty() ? "" : " [" + names + "]";
+    }
+
+    double sinceSubmit() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pendingStart).count();
+    }
+
+    void start(bool wait, const std::string &variant)
+    {
+        const std::string &path = computePath.empty() ? fragmentPath : computePath;
+        name = path.substr(path.find_last_of('/') + 1) + variant;
+        Submit();
+        if (wait)
+            Finish();
+    }
+
+    // #defines have to follow the #version line
+    void injectDefines(std::string &code) const
+    {
+        if (defines.empty() || code.empty())
+            return;
+        size_t lineEnd = code.compare(0, 8, "#version") == 0 ? code.find('\n') : std::string::npos;
+        if (lineEnd == std::string::npos)
+            code.insert(0, defines);
+        else
+            code.insert(lineEnd + 1, defines);
+    }
+
+    static bool readFile(const std::string &path, std::string &code)
+    {
+        std::ifstream file;
+        // ensure ifstream objects can throw exceptions:
+        file.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            file.open(path);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            code = stream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // newest modification time of the source files, in nanoseconds
+    long long modifiedTime() const
+    {
+        long long newest = 0;
+        for (const std::string *path : {&vertexPath, &fragmentPath, &geometryPath, &computePath})
+        {
+            struct stat st;
+            if (!path->empty() && stat(path->c_str(), &st) == 0)
+                newest = std::max(newest, (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec);
+        }
+        return newest;
+    }
+
+    void deleteShaders()
+    {
+        for (unsigned int &shader : pendingShaders)
+        {
+            if (shader)
+                glDeleteShader(shader);
+            shader = 0;
+        }
+    }
+
+    void discardPending()
+    {
+        deleteShaders();
+        if (pendingID)
+            GLState::Get().DeleteProgram(pendingID);
+        pendingID = 0;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
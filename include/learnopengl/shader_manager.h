@@ -0,0 +1,115 @@
+#ifndef SHADER_MANAGER_H
+#define SHADER_MANAGER_H
+
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/shader.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Keeps the programs of the renderer building in the background and up to date with their source files.
+// Shaders are constructed without waiting and handed to Add(); Update() runs once per frame, swaps in every
+// program the driver has finished and resubmits the ones whose .vs/.fs/.gs changed on disk. A program keeps
+// drawing with its previous ID until the new one links, so an edit never costs a frame. The uniforms that
+// are set once (sampler units and such) are lost with the old program, they go in an OnLink() callback.
+class ShaderManager
+{
+public:
+    // how often Update() looks at the source files
+    float reloadInterval = 0.5f;
+
+    ShaderManager()
+    {
+        if (GLExtensions::Get().MaxShaderCompilerThreads)
+            GLExtensions::Get().MaxShaderCompilerThreads(0xFFFFFFFFu); // as many as the driver likes
+        std::cout << "SHADER::MANAGER parallel compile "
+                  << (GLExtensions::Get().parallelShaderCompile ? "available" : "not available, links block")
+                  << std::endl;
+    }
+
+    void Add(Shader &shader)
+    {
+        entries.push_back(Entry{&shader, {}});
+    }
+
+    // runs setup right away if the shader is linked, and again every time a new program is swapped in
+    void OnLink(Shader &shader, std::function<void(Shader &)> setup)
+    {
+        Entry &entry = find(shader);
+        if (shader.ID)
+            setup(shader);
+        entry.setup.push_back(std::move(setup));
+    }
+
+    // blocks until the shader's submitted program is done
+    void Wait(Shader &shader)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while (shader.Pending() && !shader.Ready())
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (shader.Finish())
+            linked(find(shader));
+        waitedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void WaitAll()
+    {
+        for (Entry &entry : entries)
+            Wait(*entry.shader);
+    }
+
+    // swaps in finished programs and resubmits changed ones, never waits for the driver
+    void Update(float time)
+    {
+        for (Entry &entry : entries)
+            if (entry.shader->Poll())
+                linked(entry);
+        if (time - lastCheck < reloadInterval)
+            return;
+        lastCheck = time;
+        for (Entry &entry : entries)
+            if (entry.shader->SourcesChanged())
+            {
+                std::cout << "SHADER::MANAGER reloading " << entry.shader->Name() << std::endl;
+                entry.shader->Submit();
+            }
+    }
+
+    unsigned int PendingCount() const
+    {
+        unsigned int count = 0;
+        for (const Entry &entry : entries)
+            count += entry.shader->Pending();
+        return count;
+    }
+    // time the main thread spent blocked in Wait()
+    double WaitedMs() const { return waitedMs; }
+
+private:
+    struct Entry {
+        Shader *shader;
+        std::vector<std::function<void(Shader &)>> setup;
+    };
+    std::vector<Entry> entries;
+    float lastCheck = 0.0f;
+    double waitedMs = 0.0;
+
+    Entry &find(Shader &shader)
+    {
+        for (Entry &entry : entries)
+            if (entry.shader == &shader)
+                return entry;
+        Add(shader);
+        return entries.back();
+    }
+
+    static void linked(Entry &entry)
+    {
+        for (auto &setup : entry.setup)
+            setup(*entry.shader);
+    }
+};
+#endif
@@ -0,0 +1,140 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <learnopengl/gpu_timer.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_manager.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The compile time permutations of one vertex/fragment pair. Feature i of the family is #defined in the
+// variants whose key has bit i set; the constants are #defined in all of them. Variants are built once per
+// key and kept, so switching a feature is a different glUseProgram rather than a branch in every fragment.
+// Each variant has its own GpuTimer, for comparing what a permutation costs on the GPU.
+class ShaderVariants
+{
+public:
+    ShaderVariants(ShaderManager &manager, const char *vertexPath, const char *fragmentPath,
+                   std::vector<std::string> features, std::vector<std::string> constants = {})
+        : manager(manager), vertexPath(vertexPath), fragmentPath(fragmentPath), features(std::move(features)),
+          constants(std::move(constants))
+    {
+    }
+    ShaderVariants(const ShaderVariants &) = delete;
+    ShaderVariants &operator=(const ShaderVariants &) = delete;
+
+    // submits the variants without waiting, the manager swaps them in as they finish
+    void Prebuild(const std::vector<unsigned int> &keys)
+    {
+        for (unsigned int key : keys)
+            build(key, false);
+    }
+
+    // the variant for key, built on the spot (and waited for) the first time it is asked for
+    Shader &Get(unsigned int key)
+    {
+        auto it = variants.find(key);
+        if (it == variants.end())
+            return build(key, true);
+        if (!it->second->shader.ID)
+            manager.Wait(it->second->shader);
+        return it->second->shader;
+    }
+
+    GpuTimer &Timer(unsigned int key) { return variants.at(key)->timer; }
+
+    // a handle that is valid in every variant: all of them resolve the same names in the same order,
+    // variants built later included, so a name's slot is its place in that list, whether or not a variant
+    // exists yet
+    template <typename T>
+    Uniform<T> uniform(const std::string &name)
+    {
+        Uniform<T> handle;
+        auto it = std::find(uniformNames.begin(), uniformNames.end(), name);
+        handle.slot = it - uniformNames.begin();
+        if (it != uniformNames.end())
+            return handle;
+        uniformNames.push_back(name);
+        for (auto &variant : variants)
+            variant.second->shader.uniform<T>(name);
+        return handle;
+    }
+
+    // set once uniforms, applied to every variant and again when one is relinked
+    void OnLink(std::function<void(Shader &)> setup)
+    {
+        for (auto &variant : variants)
+            manager.OnLink(variant.second->shader, setup);
+        setups.push_back(std::move(setup));
+    }
+
+    void ForEach(const std::function<void(unsigned int key, Shader &shader, GpuTimer &timer)> &visit)
+    {
+        for (auto &variant : variants)
+            visit(variant.first, variant.second->shader, variant.second->timer);
+    }
+
+    void Report()
+    {
+        ForEach([](unsigned int key, Shader &shader, GpuTimer &timer) {
+            if (timer.Samples())
+                std::cout << "SHADER::VARIANT " << shader.Name() << ": " << timer.Ms() << " ms GPU over "
+                          << timer.Samples() << " frames" << std::endl;
+        });
+    }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        for (auto &variant : variants)
+            variant.second->timer.Release();
+    }
+
+private:
+    struct Variant {
+        Shader shader;
+        GpuTimer timer;
+
+        Variant(const char *vertexPath, const char *fragmentPath, const std::vector<std::string> &defines)
+            : shader(vertexPath, fragmentPath, defines, false)
+        {
+        }
+    };
+
+    ShaderManager &manager;
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> features, constants;
+    std::map<unsigned int, std::unique_ptr<Variant>> variants;
+    std::vector<std::string> uniformNames;
+    std::vector<std::function<void(Shader &)>> setups;
+
+    Shader &build(unsigned int key, bool wait)
+    {
+        auto it = variants.find(key);
+        if (it != variants.end())
+            return it->second->shader;
+        std::vector<std::string> defines;
+        for (size_t i = 0; i < features.size(); i++)
+            if (key & (1u << i))
+                defines.push_back(features[i]);
+        defines.insert(defines.end(), constants.begin(), constants.end());
+        std::unique_ptr<Variant> variant(new Variant(vertexPath.c_str(), fragmentPath.c_str(), defines));
+        Shader &shader = variant->shader;
+        variants[key] = std::move(variant);
+        for (const std::string &name : uniformNames)
+            shader.uniform<int>(name);
+        manager.Add(shader);
+        for (auto &setup : setups)
+            manager.OnLink(shader, setup);
+        if (wait)
+            manager.Wait(shader);
+        return shader;
+    }
+};
+#endif
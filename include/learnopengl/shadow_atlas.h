@@ -0,0 +1,400 @@
+#ifndef SHADOW_ATLAS_H
+#define SHADOW_ATLAS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/frustum.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/gpu_timer.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// what a spot light's shadow depends on
+struct SpotShadowCaster {
+    glm::vec3 position;
+    glm::vec3 direction;
+    float outerCutOff;   // cosine, like SpotLight's
+    float radius;        // LightRadius(), the far plane of its shadow map
+};
+
+// std430 mirror of ShadowTile in the shaders: light space straight to atlas texture coordinates and depth,
+// and the tile's texture rectangle (min xy, max xy) that lookups are kept inside of
+struct GpuShadowTile {
+    glm::mat4 matrix;
+    glm::vec4 bounds;
+};
+static_assert(sizeof(GpuShadowTile) == 80, "GpuShadowTile has to match the std430 layout of ShadowTile");
+
+// Shadow maps of static spot lights, cached as tiles of one depth atlas. A tile is rendered once and again only
+// when its light changes (SetLight() compares what it is given), the geometry near it changes (InvalidateBounds()),
+// Invalidate() is called, or its size changes. Tile sizes are powers of two picked by how large the light's lit
+// spot is on screen, the most important lights first until the atlas is full. Tiles come from a buddy allocator,
+// so a light that changes size gets a new tile and every other tile stays where it is. Update() renders at most
+// budget stale tiles a frame; until its turn comes a light keeps sampling what it last rendered, in the old tile
+// if it was resized, which is only freed once the new one holds its shadow.
+class ShadowAtlas
+{
+public:
+    static const unsigned int MIN_TILE = 64, MAX_TILE = 512;
+
+    ShadowAtlas() = default;
+    ShadowAtlas(const ShadowAtlas &) = delete;
+    ShadowAtlas &operator=(const ShadowAtlas &) = delete;
+
+    void Create(unsigned int lightCount, unsigned int size)
+    {
+        this->size = size;
+        lights.assign(lightCount, Light());
+        order.reserve(lightCount);
+        // a free list per block size from the whole atlas down to MIN_TILE, each as long as it can ever get
+        freeBlocks.clear();
+        for (unsigned int block = size; block >= MIN_TILE; block /= 2)
+        {
+            freeBlocks.emplace_back();
+            freeBlocks.back().reserve((size_t)(size / block) * (size / block));
+        }
+        freeBlocks[0].push_back({0, 0});
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // sampler2DShadow with a filtered compare gives 2x2 PCF
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glGenFramebuffers(1, &framebuffer);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer not complete!" << std::endl;
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        gpuTiles.assign(lightCount, GpuShadowTile());
+        glGenBuffers(1, &tileBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(lightCount, 1) * sizeof(GpuShadowTile), nullptr,
+                     GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        std::cout << "SHADOW::ATLAS " << size << "x" << size << ", " << Bytes() / (1024 * 1024) << " MB for "
+                  << lightCount << " spot lights" << std::endl;
+    }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        if (framebuffer)
+            glDeleteFramebuffers(1, &framebuffer);
+        if (texture)
+            GLState::Get().DeleteTextures(1, &texture);
+        if (tileBuffer)
+            glDeleteBuffers(1, &tileBuffer);
+        framebuffer = texture = tileBuffer = 0;
+        timer.Release();
+    }
+
+    void SetLight(unsigned int index, const SpotShadowCaster &caster)
+    {
+        Light &light = lights[index];
+        if (light.set && memcmp(&light.caster, &caster, sizeof(caster)) == 0)
+            return;
+        light.caster = caster;
+        light.set = true;
+        light.stale = true;
+        float angle = std::acos(glm::clamp(caster.outerCutOff, -1.0f, 1.0f));
+        glm::vec3 up = std::abs(caster.direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        // a little wider than the cone, so the filter at its edge still reads the tile
+        light.lightSpace = glm::perspective(std::min(2.0f * angle * 1.1f, glm::radians(170.0f)), 1.0f, 0.05f,
+                                            std::max(caster.radius, 0.1f)) *
+                           glm::lookAt(caster.position, caster.position + caster.direction, up);
+        light.footprint = std::max(caster.radius, 0.1f) * std::tan(std::min(angle, glm::radians(85.0f)));
+    }
+
+    // the geometry inside the box changed, the lights that reach it render their tile again
+    void InvalidateBounds(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+    {
+        for (Light &light : lights)
+        {
+            glm::vec3 offset = light.caster.position - glm::clamp(light.caster.position, boundsMin, boundsMax);
+            if (glm::dot(offset, offset) <= light.caster.radius * light.caster.radius)
+                light.stale = true;
+        }
+    }
+
+    void Invalidate()
+    {
+        for (Light &light : lights)
+            light.stale = true;
+    }
+
+    // sizes the tiles for this view and renders up to budget stale ones; drawScene(shader) draws the shadow
+    // casters with the depth shader, which takes the light's matrix as "lightSpace"
+    template <typename DrawScene>
+    void Update(const glm::vec3 &cameraPosition, const Frustum &frustum, float focalPixels, unsigned int budget,
+                Shader &depth, DrawScene &&drawScene)
+    {
+        refreshed = 0;
+        resize(cameraPosition, frustum, focalPixels);
+
+        GLint viewport[4] = {};
+        bool rendering = false;
+        for (unsigned int i : order)
+        {
+            Light &light = lights[i];
+            if (!light.stale || !light.set || !light.tile)
+                continue;
+            if (refreshed == budget)
+                break;
+            if (!rendering)
+            {
+                rendering = true;
+                glGetIntegerv(GL_VIEWPORT, viewport);
+                timer.Begin();
+                GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                GLState::Get().Enable(GL_SCISSOR_TEST);
+                GLState::Get().Enable(GL_DEPTH_TEST);
+                GLState::Get().DepthMask(GL_TRUE);
+                GLState::Get().DepthFunc(GL_LESS);
+                depth.use();
+            }
+            glViewport(light.x, light.y, light.tile, light.tile);
+            glScissor(light.x, light.y, light.tile, light.tile);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            depth.setMat4("lightSpace", light.lightSpace);
+            drawScene(depth);
+            light.renderedSpace = light.lightSpace;
+            light.stale = false;
+            // the shaders move over to the new tile, the one they read until now is free again
+            if (light.renderedTile && !light.SameTile())
+                release(light.renderedX, light.renderedY, light.renderedTile);
+            light.renderedTile = light.tile;
+            light.renderedX = light.x;
+            light.renderedY = light.y;
+            refreshed++;
+        }
+        if (rendering)
+        {
+            GLState::Get().Disable(GL_SCISSOR_TEST);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            timer.End();
+        }
+        upload();
+    }
+
+    // the shadow of light index for the shaders' ShadowTile buffer, -1 while its tile isn't rendered
+    int ShadowIndex(unsigned int index) const { return lights[index].renderedTile ? (int)index : -1; }
+
+    void Bind(unsigned int textureUnit, unsigned int tileBinding) const
+    {
+        GLState::Get().BindTextureUnit(textureUnit, GL_TEXTURE_2D, texture);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, tileBinding, tileBuffer);
+    }
+
+    unsigned int Size() const { return size; }
+    size_t Bytes() const { return (size_t)size * size * 4; }   // 24 bit depth is stored in 32 bits
+    unsigned int TilesRefreshed() const { return refreshed; }
+    unsigned int TileSize(unsigned int index) const { return lights[index].tile; }
+    unsigned int StaleCount() const
+    {
+        unsigned int count = 0;
+        for (const Light &light : lights)
+            count += light.stale;
+        return count;
+    }
+    GpuTimer &Timer() { return timer; }
+
+private:
+    struct Light {
+        SpotShadowCaster caster = {};
+        glm::mat4 lightSpace = glm::mat4(1.0f);
+        glm::mat4 renderedSpace = glm::mat4(1.0f);   // of what the rendered tile holds, kept until rendered again
+        float footprint = 0.0f;   // radius of the lit spot at the end of the cone
+        float importance = 0.0f;  // that radius in pixels on screen
+        // the tile to render into, and the one the shaders read; they differ while a resized tile waits its turn
+        unsigned int tile = 0, x = 0, y = 0;
+        unsigned int renderedTile = 0, renderedX = 0, renderedY = 0;
+        bool set = false, stale = true;
+
+        bool SameTile() const { return tile == renderedTile && x == renderedX && y == renderedY; }
+    };
+    struct Block {
+        unsigned int x, y;
+    };
+
+    unsigned int size = 0;
+    unsigned int texture = 0, framebuffer = 0, tileBuffer = 0;
+    std::vector<Light> lights;
+    std::vector<GpuShadowTile> gpuTiles;
+    std::vector<unsigned int> order;   // most important first
+    // free blocks, [0] of the atlas size, each next one half as wide
+    std::vector<std::vector<Block>> freeBlocks;
+    unsigned int refreshed = 0;
+    GpuTimer timer;
+
+    // picks every light's tile size; a light whose size changed gets a new tile and goes stale
+    void resize(const glm::vec3 &cameraPosition, const Frustum &frustum, float focalPixels)
+    {
+        if (order.size() != lights.size())
+        {
+            order.resize(lights.size());
+            for (unsigned int i = 0; i < order.size(); i++)
+                order[i] = i;
+        }
+        for (Light &light : lights)
+        {
+            glm::vec3 spot = light.caster.position + light.caster.direction * light.caster.radius;
+            bool visible = frustum.Sphere(light.caster.position, light.caster.radius);
+            float distance = std::max(glm::length(spot - cameraPosition) - light.footprint, 0.5f);
+            light.importance = visible ? light.footprint / distance * focalPixels : 0.0f;
+        }
+        // std::sort, stable_sort takes a temporary buffer from the heap; the index makes the order total
+        std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+            return lights[a].importance > lights[b].importance ||
+                   (lights[a].importance == lights[b].importance && a < b);
+        });
+
+        // every light keeps at least the smallest tile, the rest of the atlas goes to the important ones
+        size_t minArea = (size_t)MIN_TILE * MIN_TILE;
+        size_t spare = (size_t)size * size - std::min<size_t>(lights.size() * minArea, (size_t)size * size);
+        for (unsigned int i : order)
+        {
+            Light &light = lights[i];
+            unsigned int wanted = MIN_TILE;
+            while (wanted < MAX_TILE && wanted < light.importance)
+                wanted *= 2;
+            // grow right away, shrink only when it is off by two sizes, so small camera moves don't reallocate
+            unsigned int tile = light.tile;
+            if (wanted > tile || wanted * 2 < tile)
+                tile = wanted;
+            while (tile > MIN_TILE && (size_t)tile * tile - minArea > spare)
+                tile /= 2;
+            if (tile != light.tile)
+                reallocate(light, tile);
+            // what the light actually holds, which is more than it should while a grown tile waits for a block
+            size_t extra = (size_t)light.tile * light.tile - std::min<size_t>((size_t)light.tile * light.tile, minArea);
+            spare -= std::min(spare, extra);
+        }
+    }
+
+    // a new tile for the light; the one it is shown from stays taken until the new one is rendered. When the
+    // atlas has no block that large right now the light keeps its tile and tries again next frame
+    void reallocate(Light &light, unsigned int tile)
+    {
+        unsigned int x, y;
+        if (!allocate(tile, x, y))
+            return;
+        // a tile that was never rendered into has nothing worth keeping
+        if (light.tile && !light.SameTile())
+            release(light.x, light.y, light.tile);
+        light.tile = tile;
+        light.x = x;
+        light.y = y;
+        light.stale = true;
+    }
+
+    unsigned int levelOf(unsigned int block) const
+    {
+        unsigned int level = 0;
+        for (unsigned int b = size; b > block; b /= 2)
+            level++;
+        return level;
+    }
+
+    // the smallest free block that holds the tile, split down to its size; the halves not taken are freed
+    bool allocate(unsigned int tile, unsigned int &x, unsigned int &y)
+    {
+        unsigned int level = levelOf(tile);
+        if (level >= freeBlocks.size())
+            return false;
+        unsigned int from = level;
+        while (freeBlocks[from].empty())
+        {
+            if (from == 0)
+                return false;
+            from--;
+        }
+        Block block = freeBlocks[from].back();
+        freeBlocks[from].pop_back();
+        for (unsigned int l = from; l < level; l++)
+        {
+            unsigned int half = (size >> l) / 2;
+            freeBlocks[l + 1].push_back({block.x + half, block.y});
+            freeBlocks[l + 1].push_back({block.x, block.y + half});
+            freeBlocks[l + 1].push_back({block.x + half, block.y + half});
+        }
+        x = block.x;
+        y = block.y;
+        return true;
+    }
+
+    // frees a tile, merging it with its three buddies into the block above whenever they are all free
+    void release(unsigned int x, unsigned int y, unsigned int tile)
+    {
+        unsigned int level = levelOf(tile);
+        while (level > 0)
+        {
+            unsigned int block = size >> level, parent = block * 2;
+            unsigned int px = x / parent * parent, py = y / parent * parent;
+            std::vector<Block> &list = freeBlocks[level];
+            unsigned int buddies = 0;
+            for (const Block &b : list)
+                if (b.x / parent * parent == px && b.y / parent * parent == py)
+                    buddies++;
+            if (buddies < 3)
+                break;
+            list.erase(std::remove_if(list.begin(), list.end(), [&](const Block &b) {
+                           return b.x / parent * parent == px && b.y / parent * parent == py;
+                       }),
+                       list.end());
+            x = px;
+            y = py;
+            level--;
+        }
+        freeBlocks[level].push_back({x, y});
+    }
+
+    void upload()
+    {
+        bool changed = false;
+        for (unsigned int i = 0; i < lights.size(); i++)
+        {
+            const Light &light = lights[i];
+            GpuShadowTile tile = {};
+            if (light.renderedTile)
+            {
+                // NDC to the tile's texture rectangle, depth to [0, 1]
+                float scale = (float)light.renderedTile / size;
+                glm::vec2 origin = glm::vec2(light.renderedX, light.renderedY) / (float)size;
+                glm::mat4 toTile(1.0f);
+                toTile[0][0] = 0.5f * scale;
+                toTile[1][1] = 0.5f * scale;
+                toTile[2][2] = 0.5f;
+                toTile[3] = glm::vec4(origin + 0.5f * scale, 0.5f, 1.0f);
+                tile.matrix = toTile * light.renderedSpace;
+                float texel = 0.5f / size;
+                tile.bounds = glm::vec4(origin + texel, origin + scale - texel);
+            }
+            if (memcmp(&tile, &gpuTiles[i], sizeof(tile)) != 0)
+            {
+                gpuTiles[i] = tile;
+                changed = true;
+            }
+        }
+        if (!changed)
+            return;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gpuTiles.size() * sizeof(GpuShadowTile), gpuTiles.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+};
+#endif
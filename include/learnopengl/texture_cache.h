@@ -0,0 +1,132 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/texture_loader.h>
+
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+// Process wide texture cache. Textures are keyed by their canonical absolute path and whether they are
+// loaded as sRGB (gamma), so every Model that references the same file the same way shares one GL texture.
+// Acquire()/Release() keep a reference count and the texture is deleted when the last reference goes away.
+// The cache also tracks how many bytes each texture keeps resident on the GPU, mip levels included.
+class TextureCache
+{
+public:
+    static TextureCache &Instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // returns the texture for the file, loading it on the first request; every call must be paired with a Release()
+    unsigned int Acquire(const std::string &path, bool gamma = false)
+    {
+        std::string canonical = canonicalPath(path);
+        std::string key = cacheKey(canonical, gamma);
+        auto it = byKey.find(key);
+        if (it != byKey.end()) {
+            it->second.refCount++;
+            return it->second.id;
+        }
+        Entry entry;
+        entry.path = canonical;
+        entry.id = TextureLoader::Instance().Load(canonical, gamma);
+        entry.refCount = 1;
+        byKey[key] = entry;
+        keyById[entry.id] = key;
+        return entry.id;
+    }
+
+    void Release(unsigned int id)
+    {
+        auto it = keyById.find(id);
+        if (it == keyById.end())
+            return;
+        Entry &entry = byKey[it->second];
+        if (--entry.refCount > 0)
+            return;
+        residentBytes -= entry.bytes;
+        if (!shutDown && !TextureLoader::Instance().Cancel(id))
+            GLState::Get().DeleteTextures(1, &id);
+        byKey.erase(it->second);
+        keyById.erase(it);
+    }
+
+    // called whenever a texture's storage changes (upload, mip changes)
+    void SetResidentBytes(unsigned int id, size_t bytes)
+    {
+        auto it = keyById.find(id);
+        if (it == keyById.end())
+            return;
+        Entry &entry = byKey[it->second];
+        residentBytes = residentBytes - entry.bytes + bytes;
+        entry.bytes = bytes;
+    }
+
+    // canonical path the texture was loaded from, empty for textures the cache doesn't own
+    std::string Path(unsigned int id) const
+    {
+        auto it = keyById.find(id);
+        return it == keyById.end() ? std::string() : byKey.at(it->second).path;
+    }
+
+    size_t ResidentBytes() const { return residentBytes; }
+    size_t TextureCount() const { return byKey.size(); }
+
+    void Report() const
+    {
+        unsigned int references = 0;
+        for (const auto &it : byKey)
+            references += it.second.refCount;
+        std::cout << "TEXTURE::CACHE " << byKey.size() << " textures, " << references << " references, "
+                  << residentBytes / (1024.0 * 1024.0) << " MB resident" << std::endl;
+    }
+
+    // frees every texture that is still referenced; call while the GL context is still current.
+    // Releases that happen afterwards (Model destructors at the end of main) only update the bookkeeping.
+    void Shutdown()
+    {
+        for (auto &it : byKey)
+            GLState::Get().DeleteTextures(1, &it.second.id);
+        shutDown = true;
+    }
+
+private:
+    struct Entry {
+        unsigned int id = 0;
+        std::string path;
+        unsigned int refCount = 0;
+        size_t bytes = 0;
+    };
+
+    std::unordered_map<std::string, Entry> byKey;
+    std::unordered_map<unsigned int, std::string> keyById;
+    size_t residentBytes = 0;
+    bool shutDown = false;
+
+    TextureCache()
+    {
+        TextureLoader::Instance().onUploaded = [this](unsigned int id, size_t bytes) { SetResidentBytes(id, bytes); };
+    }
+
+    // the same file loaded linear and as sRGB makes two textures
+    static std::string cacheKey(const std::string &canonical, bool gamma)
+    {
+        return (gamma ? "srgb:" : "linear:") + canonical;
+    }
+
+    static std::string canonicalPath(const std::string &path)
+    {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+        return path;
+    }
+};
+#endif
@@ -0,0 +1,359 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/dds.h>
+#include <learnopengl/gl_state.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// EXT_texture_compression_s3tc, not part of the core profile glad was generated for
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+// and their sRGB versions from EXT_texture_sRGB
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Decodes image files on a pool of worker threads and uploads them on the GL thread.
+// Load() only reserves a texture name and queues the file, so the caller can keep doing GL work
+// (compiling shaders, building framebuffers) while the images decode. The GL thread then calls
+// Process() to upload whatever finished, or Finish() to block until everything is resident.
+// When tools/texture_cooker has written a <name>.dds next to the image (and it is not older than the
+// image), the workers read that instead and the upload goes through glCompressedTexImage2D with the
+// cooked mip chain, so neither the JPEG decode nor glGenerateMipmap runs. A texture loaded with gamma gets an
+// sRGB internal format, so the sampler hands the shaders linear colors.
+// At most maxReadyImages decoded images wait for their upload; beyond that the workers wait as well, so the
+// memory held by decoded images stays bounded no matter how many textures are queued before Process() runs.
+class TextureLoader
+{
+public:
+    // called on the GL thread after each upload with the bytes the texture now keeps resident
+    std::function<void(unsigned int id, size_t bytes)> onUploaded;
+    // when non zero, cooked textures start out with only the mip levels no larger than this resident;
+    // the TextureStreamer brings in the rest as they are needed
+    unsigned int cookedInitialSize = 0;
+    // decoded images allowed to wait for Process(), set before the first Load()
+    size_t maxReadyImages = 8;
+
+    static TextureLoader &Instance()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    // returns the texture name right away, the image itself arrives on a later Process()/Finish()
+    unsigned int Load(const std::string &path, bool gamma = false)
+    {
+        startWorkers();
+        if (!checkedCompression) {
+            compressionSupported = extensionSupported("GL_EXT_texture_compression_s3tc");
+            srgbCompressionSupported = compressionSupported && extensionSupported("GL_EXT_texture_sRGB");
+            checkedCompression = true;
+        }
+        Job job;
+        glGenTextures(1, &job.id);
+        job.path = path;
+        job.gamma = gamma;
+        job.queued = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queuedIds.insert(job.id);
+            jobs.push_back(job);
+            pending++;
+        }
+        jobAvailable.notify_one();
+        return job.id;
+    }
+
+    // the owner no longer wants the texture; returns true if its image is still on the way, in which case
+    // the loader drops the image and deletes the texture name itself once the decode finishes
+    bool Cancel(unsigned int id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!queuedIds.count(id))
+            return false;
+        cancelled.insert(id);
+        return true;
+    }
+
+    // uploads every decoded image that is ready; with wait set, keeps going until nothing is pending
+    void Process(bool wait = false)
+    {
+        while (true) {
+            Job job;
+            bool drop;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (wait)
+                    jobDone.wait(lock, [this] { return !done.empty() || pending == 0; });
+                if (done.empty())
+                    return;
+                job = std::move(done.front());
+                done.pop_front();
+                queuedIds.erase(job.id);
+                drop = cancelled.erase(job.id) > 0;
+            }
+            doneSpace.notify_one();
+            if (drop) {
+                stbi_image_free(job.data);
+                GLState::Get().DeleteTextures(1, &job.id);
+            }
+            else
+                upload(job);
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+        }
+    }
+
+    // blocks until every queued texture is uploaded and prints a summary of the batch
+    void Finish()
+    {
+        auto start = std::chrono::steady_clock::now();
+        Process(true);
+        if (uploaded == 0)
+            return;
+        std::cout << "TEXTURE::LOADER " << uploaded << " textures on " << workers.size() << " workers: decode "
+                  << totalDecodeMs << " ms, upload " << totalUploadMs << " ms, wall " << maxWallMs
+                  << " ms (blocked " << elapsedMs(start) << " ms in Finish)" << std::endl;
+        uploaded = 0;
+        totalDecodeMs = totalUploadMs = maxWallMs = 0.0;
+    }
+
+    ~TextureLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        doneSpace.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+        for (Job &job : done)
+            stbi_image_free(job.data);
+    }
+
+private:
+    struct Job {
+        unsigned int id = 0;
+        std::string path;
+        bool gamma = false;
+        unsigned char *data = nullptr;
+        int width = 0, height = 0, nrComponents = 0;
+        // cooked file contents, used instead of data when the image had one
+        std::vector<unsigned char> cooked;
+        DdsImage dds;
+        double decodeMs = 0.0;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    std::mutex mutex;
+    std::condition_variable jobAvailable, jobDone, doneSpace;
+    std::deque<Job> jobs, done;
+    std::unordered_set<unsigned int> queuedIds, cancelled;
+    std::vector<std::thread> workers;
+    size_t pending = 0;
+    bool stopping = false;
+    // written once on the GL thread before the first job is queued
+    bool checkedCompression = false, compressionSupported = false, srgbCompressionSupported = false;
+
+    // batch statistics, only touched on the GL thread
+    unsigned int uploaded = 0;
+    double totalDecodeMs = 0.0, totalUploadMs = 0.0, maxWallMs = 0.0;
+
+    TextureLoader() {}
+
+    static double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void startWorkers()
+    {
+        if (!workers.empty())
+            return;
+        // leave one core to the GL thread
+        unsigned int cores = std::thread::hardware_concurrency();
+        unsigned int count = cores > 1 ? cores - 1 : 1;
+        for (unsigned int i = 0; i < count; i++)
+            workers.emplace_back(&TextureLoader::workerLoop, this);
+    }
+
+    void workerLoop()
+    {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            auto start = std::chrono::steady_clock::now();
+            bool cookedUsable = job.gamma ? srgbCompressionSupported : compressionSupported;
+            if (!cookedUsable || !readCooked(job))
+                job.data = stbi_load(job.path.c_str(), &job.width, &job.height, &job.nrComponents, 0);
+            job.decodeMs = elapsedMs(start);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                doneSpace.wait(lock, [this] { return stopping || done.size() < maxReadyImages; });
+                if (stopping) {
+                    stbi_image_free(job.data);
+                    return;
+                }
+                done.push_back(std::move(job));
+            }
+            jobDone.notify_one();
+        }
+    }
+
+    static bool extensionSupported(const char *name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+            if (std::string((const char *)glGetStringi(GL_EXTENSIONS, i)) == name)
+                return true;
+        return false;
+    }
+
+    // loads <name>.dds into the job if the cooker produced one that is at least as new as the image
+    static bool readCooked(Job &job)
+    {
+        std::string ddsPath = DdsPathFor(job.path);
+        struct stat ddsStat, imageStat;
+        if (stat(ddsPath.c_str(), &ddsStat) != 0)
+            return false;
+        if (stat(job.path.c_str(), &imageStat) == 0 && imageStat.st_mtime > ddsStat.st_mtime) {
+            std::cout << "TEXTURE::LOAD " << ddsPath << " is older than " << job.path << ", using the image" << std::endl;
+            return false;
+        }
+        std::ifstream in(ddsPath, std::ios::binary);
+        job.cooked.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (!DdsParse(job.cooked.data(), job.cooked.size(), job.dds)) {
+            std::cout << "TEXTURE::LOAD " << ddsPath << " is not a valid cooked texture, using the image" << std::endl;
+            job.cooked.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // size of a full mip chain down to 1x1
+    static size_t mipChainBytes(int width, int height, int bytesPerTexel)
+    {
+        size_t bytes = 0;
+        while (true) {
+            bytes += (size_t)width * height * bytesPerTexel;
+            if (width == 1 && height == 1)
+                return bytes;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+    }
+
+    void upload(Job &job)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        if (!job.cooked.empty())
+        {
+            GLenum format;
+            if (job.dds.format == DdsFormat::BC1)
+                format = job.gamma ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            else
+                format = job.gamma ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            unsigned int baseLevel = 0;
+            if (cookedInitialSize > 0)
+                while (baseLevel + 1 < job.dds.levels.size() &&
+                       std::max(job.dds.levels[baseLevel].width, job.dds.levels[baseLevel].height) > cookedInitialSize)
+                    baseLevel++;
+            GLState::Get().BindTexture(GL_TEXTURE_2D, job.id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, baseLevel);
+            for (unsigned int level = baseLevel; level < job.dds.levels.size(); level++)
+            {
+                const DdsLevel &l = job.dds.levels[level];
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, format, l.width, l.height, 0, l.size, job.cooked.data() + l.offset);
+                bytes += l.size;
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job.dds.levels.size() - 1);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            std::vector<unsigned char>().swap(job.cooked);
+        }
+        else if (job.data)
+        {
+            GLenum format = GL_RGB;
+            if (job.nrComponents == 1)
+                format = GL_RED;
+            else if (job.nrComponents == 3)
+                format = GL_RGB;
+            else if (job.nrComponents == 4)
+                format = GL_RGBA;
+            // single channel maps hold data, not color
+            GLenum internalFormat = format;
+            if (job.gamma && format == GL_RGB)
+                internalFormat = GL_SRGB8;
+            else if (job.gamma && format == GL_RGBA)
+                internalFormat = GL_SRGB8_ALPHA8;
+
+            GLState::Get().BindTexture(GL_TEXTURE_2D, job.id);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, job.data);
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            stbi_image_free(job.data);
+            job.data = nullptr;
+            bytes = mipChainBytes(job.width, job.height, job.nrComponents);
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << job.path << std::endl;
+        }
+        double uploadMs = elapsedMs(start);
+        double wallMs = elapsedMs(job.queued);
+        std::cout << "TEXTURE::LOAD " << job.path << (job.dds.levels.empty() ? "" : " (cooked)") << ": decode "
+                  << job.decodeMs << " ms, upload " << uploadMs << " ms, wall " << wallMs << " ms, "
+                  << bytes / (1024.0 * 1024.0) << " MB" << std::endl;
+        if (onUploaded)
+            onUploaded(job.id, bytes);
+        uploaded++;
+        totalDecodeMs += job.decodeMs;
+        totalUploadMs += uploadMs;
+        maxWallMs = std::max(maxWallMs, wallMs);
+    }
+};
+#endif
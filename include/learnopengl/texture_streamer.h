@@ -0,0 +1,210 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/dds.h>
+#include <learnopengl/frame_arena.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_loader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Keeps only as many mip levels of each cooked texture resident as its meshes need on screen.
+// Every frame the projected size of the meshes using a texture (from their bounds and the camera)
+// picks the finest mip worth having; missing levels are uploaded from the mapped .dds file a few
+// megabytes per frame, and levels that are no longer needed, or that don't fit in the VRAM budget,
+// are released again. Textures without a cooked file stay fully resident and are left alone.
+class TextureStreamer
+{
+public:
+    struct StreamedTexture {
+        unsigned int id = 0;
+        std::string path;
+        std::unique_ptr<MappedFile> file;
+        DdsImage dds;
+        GLenum format = 0;
+        unsigned int residentLevel = 0;  // finest level currently on the GPU (GL_TEXTURE_BASE_LEVEL)
+        unsigned int desiredLevel = 0;
+        float projectedSize = 0.0f;      // largest on screen size of the meshes using it, in pixels
+        size_t residentBytes = 0;
+        std::vector<const Mesh *> meshes;
+    };
+
+    size_t budgetBytes = 256u * 1024 * 1024;
+    size_t uploadBytesPerFrame = 16u * 1024 * 1024;
+
+    // registers the diffuse textures of the meshes, except the ones listed in skip (drawn from elsewhere);
+    // the meshes must outlive the streamer
+    void AddMeshes(const std::vector<Mesh> &meshes, const std::vector<unsigned int> &skip = std::vector<unsigned int>())
+    {
+        for (const Mesh &mesh : meshes)
+            for (const Texture &texture : mesh.textures)
+                if (texture.type == TEXTURE_DIFFUSE && std::find(skip.begin(), skip.end(), texture.id) == skip.end())
+                    addMesh(texture.id, mesh);
+    }
+
+    // the upload order is built in arena, which has to outlive the call only
+    void Update(const glm::vec3 &cameraPosition, float fovY, float screenHeight, FrameArena &arena)
+    {
+        if (textures.empty())
+            return;
+        // how many pixels a unit long object covers at distance 1
+        float pixelsPerUnit = screenHeight / (2.0f * std::tan(fovY * 0.5f));
+        for (StreamedTexture &t : textures) {
+            t.projectedSize = 0.0f;
+            for (const Mesh *mesh : t.meshes) {
+                glm::vec3 center = (mesh->boundsMin + mesh->boundsMax) * 0.5f;
+                float radius = glm::length(mesh->boundsMax - mesh->boundsMin) * 0.5f;
+                float distance = std::max(glm::length(center - cameraPosition) - radius, 0.1f);
+                t.projectedSize = std::max(t.projectedSize, 2.0f * radius / distance * pixelsPerUnit);
+            }
+            t.desiredLevel = levelForSize(t, t.projectedSize);
+        }
+
+        // over budget: coarsen the texture that has the most texels per covered pixel until everything fits
+        size_t total = 0;
+        for (const StreamedTexture &t : textures)
+            total += chainBytes(t, t.desiredLevel);
+        while (total > budgetBytes) {
+            StreamedTexture *coarsest = nullptr;
+            float worstDensity = -1.0f;
+            for (StreamedTexture &t : textures) {
+                if (t.desiredLevel + 1 >= t.dds.levels.size())
+                    continue;
+                float density = levelSize(t, t.desiredLevel) / std::max(t.projectedSize, 1.0f);
+                if (density > worstDensity) {
+                    worstDensity = density;
+                    coarsest = &t;
+                }
+            }
+            if (!coarsest)
+                break;
+            total -= chainBytes(*coarsest, coarsest->desiredLevel) - chainBytes(*coarsest, coarsest->desiredLevel + 1);
+            coarsest->desiredLevel++;
+        }
+        bool overBudget = ResidentBytes() > budgetBytes;
+
+        // drop first so uploads have room, then refine the largest textures on screen first
+        for (StreamedTexture &t : textures)
+            // one level of slack so a painting at the edge of a level doesn't flip every frame
+            if (t.desiredLevel > t.residentLevel + 1 || (overBudget && t.desiredLevel > t.residentLevel))
+                dropTo(t, t.desiredLevel);
+        StreamedTexture **order = arena.Allocate<StreamedTexture *>(textures.size());
+        size_t orderCount = 0;
+        for (StreamedTexture &t : textures)
+            if (t.desiredLevel < t.residentLevel)
+                order[orderCount++] = &t;
+        std::sort(order, order + orderCount, [](const StreamedTexture *a, const StreamedTexture *b) {
+            return a->projectedSize > b->projectedSize;
+        });
+        size_t uploadBudget = uploadBytesPerFrame;
+        for (size_t i = 0; i < orderCount; i++) {
+            StreamedTexture *t = order[i];
+            while (t->desiredLevel < t->residentLevel && uploadBudget > 0) {
+                size_t uploaded = uploadLevel(*t, t->residentLevel - 1);
+                uploadBudget -= std::min(uploadBudget, uploaded);
+            }
+        }
+    }
+
+    const std::vector<StreamedTexture> &Textures() const { return textures; }
+
+    size_t ResidentBytes() const
+    {
+        size_t bytes = 0;
+        for (const StreamedTexture &t : textures)
+            bytes += t.residentBytes;
+        return bytes;
+    }
+
+private:
+    std::vector<StreamedTexture> textures;
+    std::vector<unsigned int> notCooked;
+
+    void addMesh(unsigned int id, const Mesh &mesh)
+    {
+        for (StreamedTexture &t : textures)
+            if (t.id == id) {
+                t.meshes.push_back(&mesh);
+                return;
+            }
+        if (std::find(notCooked.begin(), notCooked.end(), id) != notCooked.end())
+            return;
+        StreamedTexture t;
+        t.id = id;
+        t.path = TextureCache::Instance().Path(id);
+        t.file.reset(new MappedFile);
+        if (t.path.empty() || !t.file->Open(DdsPathFor(t.path)) || !DdsParse(t.file->data, t.file->size, t.dds))
+        {
+            // not cooked, stays fully resident
+            notCooked.push_back(id);
+            return;
+        }
+        // the loader may already have started it out at a coarser level; levels come back in the format it
+        // picked, sRGB or not
+        GLint baseLevel = 0, format = 0;
+        GLState::Get().BindTexture(GL_TEXTURE_2D, id);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_INTERNAL_FORMAT, &format);
+        t.format = format;
+        t.residentLevel = t.desiredLevel = baseLevel;
+        t.residentBytes = chainBytes(t, t.residentLevel);
+        t.meshes.push_back(&mesh);
+        textures.push_back(std::move(t));
+    }
+
+    static float levelSize(const StreamedTexture &t, unsigned int level)
+    {
+        return (float)std::max(t.dds.levels[level].width, t.dds.levels[level].height);
+    }
+
+    // coarsest level that still has at least one texel per pixel the texture covers on screen
+    static unsigned int levelForSize(const StreamedTexture &t, float pixels)
+    {
+        unsigned int level = 0;
+        while (level + 1 < t.dds.levels.size() && levelSize(t, level + 1) >= pixels)
+            level++;
+        return level;
+    }
+
+    static size_t chainBytes(const StreamedTexture &t, unsigned int fromLevel)
+    {
+        size_t bytes = 0;
+        for (unsigned int level = fromLevel; level < t.dds.levels.size(); level++)
+            bytes += t.dds.levels[level].size;
+        return bytes;
+    }
+
+    size_t uploadLevel(StreamedTexture &t, unsigned int level)
+    {
+        const DdsLevel &l = t.dds.levels[level];
+        GLState::Get().BindTexture(GL_TEXTURE_2D, t.id);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, t.format, l.width, l.height, 0, l.size, t.file->data + l.offset);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        t.residentLevel = level;
+        t.residentBytes = chainBytes(t, level);
+        TextureCache::Instance().SetResidentBytes(t.id, t.residentBytes);
+        return l.size;
+    }
+
+    // levels below the base level don't take part in completeness, redefining them as empty frees their storage
+    void dropTo(StreamedTexture &t, unsigned int level)
+    {
+        GLState::Get().BindTexture(GL_TEXTURE_2D, t.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        for (unsigned int l = t.residentLevel; l < level; l++)
+            glCompressedTexImage2D(GL_TEXTURE_2D, l, t.format, 0, 0, 0, 0, nullptr);
+        t.residentLevel = level;
+        t.residentBytes = chainBytes(t, level);
+        TextureCache::Instance().SetResidentBytes(t.id, t.residentBytes);
+    }
+};
+#endif
@@ -0,0 +1,150 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/render_stats.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// std140 mirror of the FrameConstants block that every program of the renderer declares. The vec3s are
+// followed by a scalar or padding that fills their fourth component, a struct starts on 16 bytes.
+struct GpuDirLight {
+    glm::vec3 direction;
+    float padding0;
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float padding3;
+};
+
+struct FrameConstants {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float time;
+    GpuDirLight dirLight;
+    float exposure;
+    float padding[3];
+    glm::vec3 sipkeColor;  // the one animated color of every sipke light, their records keep white
+    float padding4;
+};
+static_assert(sizeof(FrameConstants) == 240, "FrameConstants has to match the std140 layout of the block");
+
+// the binding point of FrameConstants, given with layout(binding = 0) in the shaders
+const unsigned int FRAME_CONSTANTS_BINDING = 0;
+
+// A uniform buffer with a slot per frame in flight. Write() fills the next slot and binds it. The GPU may
+// still be reading a slot two frames on, so each slot has a fence, placed by Fence() after the frame's last
+// draw, and Write() waits on it before overwriting; the time spent waiting goes into RenderStats. With
+// glBufferStorage the buffer stays mapped and the slot is flushed explicitly, otherwise it is glBufferSubData.
+template<typename T>
+class UniformRing
+{
+public:
+    static const unsigned int SLOTS = 3;
+
+    UniformRing() = default;
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    void Create(const std::string &name)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+        GLsizeiptr size = stride * SLOTS;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (GLExtensions::Get().BufferStorage)
+        {
+            GLExtensions::Get().BufferStorage(GL_UNIFORM_BUFFER, size, nullptr, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+            mapped = (char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size,
+                                              GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+            if (!mapped)
+            {
+                // immutable storage can't be respecified, start over with a mutable buffer
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            }
+        }
+        if (!mapped)
+            glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        std::cout << "UNIFORM::RING " << name << ": " << SLOTS << " x " << stride << " bytes, "
+                  << (mapped ? "persistently mapped" : "glBufferSubData") << std::endl;
+    }
+
+    // call while the GL context is still current
+    void Release()
+    {
+        for (GLsync &fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        if (mapped)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+        mapped = nullptr;
+        buffer = 0;
+    }
+
+    // moves to the next slot, writes data there and binds it to binding
+    void Write(const T &data, unsigned int binding)
+    {
+        slot = (slot + 1) % SLOTS;
+        GLintptr offset = slot * stride;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (mapped)
+        {
+            if (fences[slot])
+            {
+                auto start = std::chrono::steady_clock::now();
+                glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                RenderStats::Frame().fenceWaitMs +=
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                glDeleteSync(fences[slot]);
+                fences[slot] = 0;
+            }
+            memcpy(mapped + offset, &data, sizeof(T));
+            glFlushMappedBufferRange(GL_UNIFORM_BUFFER, offset, sizeof(T));
+        }
+        else
+            glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, sizeof(T));
+    }
+
+    // after the last draw that reads the current slot
+    void Fence()
+    {
+        if (!mapped)
+            return;
+        if (fences[slot])
+            glDeleteSync(fences[slot]);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    unsigned int buffer = 0;
+    GLsizeiptr stride = 0;
+    char *mapped = nullptr;
+    GLsync fences[SLOTS] = {};
+    unsigned int slot = SLOTS - 1;
+};
+#endif
@@ -6,8 +6,29 @@ in vec2 TexCoords;
 uniform sampler2D scene;
 uniform sampler2D bloomBlur;
 uniform sampler2D mask;
+#ifdef UNIFORM_BRANCHES
 uniform bool bloom;
-uniform float exposure;
+#elif defined(BLOOM)
+const bool bloom = true;
+#else
+const bool bloom = false;
+#endif
+// written once a frame into a ring of uniform buffers, FrameConstants in uniform_ring.h mirrors it (std140)
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+layout (std140, binding = 0) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float time;
+    DirLight dirLight;
+    float exposure;
+    vec3 sipkeColor;
+};
 
 void main()
 {
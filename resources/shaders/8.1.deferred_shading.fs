@@ -8,6 +8,8 @@ uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedoSpec;
 uniform sampler2D gMask;
+// ambient and diffuse light of the frame and spot lights baked by lightmap_baker, alpha 1 where it covers
+uniform sampler2D gBaked;
 float near = 0.1;
 float far  = 100.0;
 
@@ -16,25 +18,35 @@ float LinearizeDepth(float depth)
     float z = depth * 2.0 - 1.0; // back to NDC
     return (2.0 * near * far) / (far + near - z * (far - near));
 }
+// the light structs are std430 and mirrored by GpuPointLight and GpuSpotLight in light_buffer.h,
+// the scalars sit in the fourth component of the vec3 before them
 struct pointLight {
     vec3 position;
-    vec3 color;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
     float constant;
+    vec3 color;
     float linear;
+    vec3 ambient;
     float quadratic;
+    vec3 diffuse;
+    float radius;
+    vec3 specular;
 };
+// written once a frame into a ring of uniform buffers, FrameConstants in uniform_ring.h mirrors it (std140)
 struct DirLight {
     vec3 direction;
-
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
 };
+layout (std140, binding = 0) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float time;
+    DirLight dirLight;
+    float exposure;
+    vec3 sipkeColor;
+};
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
@@ -42,37 +54,99 @@ struct Material {
     float shininess;
 };
 struct SpotLight{
-   float constant;
-   float linear;
-   float quadratic;
-
-   float cutOff;
-   float outerCutOff;
-
    vec3 position;
+   float cutOff;
    vec3 direction;
-
+   float outerCutOff;
    vec3 ambient;
+   float constant;
    vec3 diffuse;
+   float linear;
    vec3 specular;
+   float quadratic;
+   float radius;
+   int shadow;
+};
+
+layout (std430, binding = 0) readonly buffer SipkeLights {
+    pointLight lightsSipke[];
+};
+layout (std430, binding = 1) readonly buffer RamoviLights {
+    pointLight lightsRamovi[];
+};
+layout (std430, binding = 2) readonly buffer SpotLights {
+    SpotLight spotLight[];
+};
+
+// the sipke lights share one color that changes every frame; it comes with the frame constants, so their
+// records in the buffer stay the same
+pointLight sipkeLight(int index)
+{
+    pointLight light = lightsSipke[index];
+    light.color = sipkeColor;
+    return light;
+}
+// the spot lights' shadow maps, tiles of one atlas (ShadowAtlas in shadow_atlas.h); matrix goes from world
+// space to the tile's texture coordinates and depth, bounds is the tile's texture rectangle
+struct ShadowTile {
+    mat4 matrix;
+    vec4 bounds;
 };
-const int NR_LIGHTS_SIPKE = 96;
-const int NR_LIGHTS_RAMOVI = 6;
-const int NR_SPOT_LIGHTS = 26;
+layout (std430, binding = 5) readonly buffer ShadowTiles {
+    ShadowTile shadowTiles[];
+};
+uniform sampler2DShadow shadowAtlas;
+// the light counts are compiled in when they are known up front, otherwise they come as uniforms;
+// with CULLED_LIGHTS only the lights the CPU found in the frustum are at the front of the buffers
+#if defined(SIPKE_LIGHTS) && defined(RAMOVI_LIGHTS) && defined(SPOT_LIGHTS) && !defined(CULLED_LIGHTS)
+const int sipkeLightCount = SIPKE_LIGHTS;
+const int ramoviLightCount = RAMOVI_LIGHTS;
+const int spotLightCount = SPOT_LIGHTS;
+#else
+uniform int sipkeLightCount;
+uniform int ramoviLightCount;
+uniform int spotLightCount;
+#endif
+
+#ifdef CLUSTERED
+// light lists built by light_culling.comp for the grid of LightClusters in light_clusters.h
+layout (std430, binding = 3) readonly buffer ClusterLightCounts {
+    uint clusterLightCount[];
+};
+layout (std430, binding = 4) readonly buffer ClusterLightIndices {
+    uint clusterLights[];
+};
+
+// the cluster the fragment is in: its screen tile and the exponential slice of its view space depth
+uint clusterIndex(vec3 fragPos)
+{
+    uvec2 tile = min(uvec2(TexCoords * vec2(CLUSTERS_X, CLUSTERS_Y)), uvec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+    float depth = max(-(view * vec4(fragPos, 1.0)).z, near);
+    uint slice = min(uint(log(depth / near) / log(far / near) * CLUSTERS_Z), uint(CLUSTERS_Z - 1));
+    return (slice * CLUSTERS_Y + tile.y) * CLUSTERS_X + tile.x;
+}
+#endif
 
-uniform pointLight lightsSipke[NR_LIGHTS_SIPKE];
-uniform pointLight lightsRamovi[NR_LIGHTS_RAMOVI];
 uniform Material material;
-uniform SpotLight spotLight[NR_SPOT_LIGHTS];
-uniform DirLight dirLight;
 uniform bool hdr;
-uniform float exposure;
-
-uniform vec3 viewPos;
+#ifdef UNIFORM_BRANCHES
 uniform bool blinn;
+#elif defined(BLINN)
+const bool blinn = true;
+#else
+const bool blinn = false;
+#endif
+
+// fades the attenuation to zero at the light's radius (LightRadius in light_buffer.h), where it is culled
+float radiusWindow(float distance, float radius)
+{
+    float ratio = distance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window;
+}
 
-// calculates the color when using a point light.
-vec3 CalcPointLight(pointLight light, vec3 normal, vec3 fragPos, vec3 viewDir,vec3 Diffuse,float Specular)
+// calculates the color when using a point light; unbaked is 0 where the lightmap already holds its ambient and diffuse part
+vec3 CalcPointLight(pointLight light, vec3 normal, vec3 fragPos, vec3 viewDir,vec3 Diffuse,float Specular,float unbaked)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -93,12 +167,13 @@ vec3 CalcPointLight(pointLight light, vec3 normal, vec3 fragPos, vec3 viewDir,ve
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= radiusWindow(distance, light.radius);
     // combine results
     vec3 ambient = light.ambient * Diffuse;
     vec3 diffuse = light.diffuse * diff * Diffuse * light.color;
     vec3 specular = light.specular * spec * Specular;
-    ambient *= attenuation;
-    diffuse *= attenuation;
+    ambient *= attenuation * unbaked;
+    diffuse *= attenuation * unbaked;
     specular *= attenuation;
     return (ambient + diffuse + specular);
 }
@@ -129,7 +204,22 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir,vec3 Diffuse,float S
 }
 
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal,vec3 viewDir,vec3 fragPos,vec3 Diffuse,float Specular){
+// 1 lit, 0 in shadow, filtered by the depth compare; the position is pushed off the surface along its normal
+float SpotShadow(int shadow, vec3 fragPos, vec3 normal)
+{
+    if (shadow < 0)
+        return 1.0;
+    ShadowTile tile = shadowTiles[shadow];
+    vec4 clip = tile.matrix * vec4(fragPos + normal * 0.03, 1.0);
+    if (clip.w <= 0.0)
+        return 1.0;
+    vec3 coord = clip.xyz / clip.w;
+    if (any(lessThan(coord.xy, tile.bounds.xy)) || any(greaterThan(coord.xy, tile.bounds.zw)) || coord.z > 1.0)
+        return 1.0;
+    return texture(shadowAtlas, vec3(coord.xy, coord.z - 0.0005));
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal,vec3 viewDir,vec3 fragPos,vec3 Diffuse,float Specular,float unbaked){
     vec3 lightDir = normalize(light.position -fragPos);
 
     float diff = max(dot(normal, lightDir),0.0);
@@ -148,6 +238,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal,vec3 viewDir,vec3 fragPos,vec3 D
 
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    attenuation *= radiusWindow(distance, light.radius);
 
     float epsilon = light.cutOff - light.outerCutOff;
     float theta = dot(-lightDir,normalize(light.direction));
@@ -158,9 +249,10 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal,vec3 viewDir,vec3 fragPos,vec3 D
     vec3 specular = light.specular * spec * Specular;
 
 
-    ambient *= attenuation;
-    diffuse*= attenuation* intensity;
-    specular *= attenuation * intensity;
+    ambient *= attenuation * unbaked;
+    float shadow = SpotShadow(light.shadow, fragPos, normal);
+    diffuse*= attenuation* intensity * shadow * unbaked;
+    specular *= attenuation * intensity * shadow;
 
 
     return (ambient + diffuse + specular);
@@ -178,11 +270,68 @@ void main()
     vec3 viewDir = normalize(FragPos - viewPos);
     vec3 result = vec3(0,0,0);
     result = CalcDirLight(dirLight, Normal, viewDir,Diffuse,Specular);
+    // the frames' baked light; only their specular is left to the frame and spot lights below
+    vec4 baked = texture(gBaked, TexCoords);
+    float unbaked = 1.0 - baked.a;
+    result += baked.rgb * Diffuse;
 
     vec3 maska = texture(gMask,TexCoords).rgb;
+#if defined(LIGHT_VOLUMES)
+    // the sun only, the point and spot lights are added by their volumes (light_volume.fs)
     if(maska == vec3(1.0,1.0,1.0)){
-        for(int i = 0; i < NR_LIGHTS_SIPKE; ++i){
-                result +=CalcPointLight(lightsSipke[i], Normal, FragPos, viewDir,Diffuse,Specular);
+        float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
+        if(brightness > 1.0)
+            BrightColor = vec4(result, 1.0);
+        else
+            BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+    }
+    else
+        BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+    FragColor = vec4(result, 1.0);
+    float depth = LinearizeDepth(gl_FragCoord.z) / far; // divide by far for demonstration
+    Depth = vec4(vec3(depth), 1.0);
+#elif defined(CLUSTERED)
+    // the same lights as the loops below, but only those whose range reaches the fragment's cluster;
+    // masked pixels take the sipke lights, the others the ramovi and spot lights
+    uint cluster = clusterIndex(FragPos);
+    uint count = clusterLightCount[cluster];
+    uint first = cluster * MAX_LIGHTS_PER_CLUSTER;
+    bool masked = maska == vec3(1.0,1.0,1.0);
+    for(uint i = 0; i < count; i++){
+        uint entry = clusterLights[first + i];
+        uint type = entry >> 16;
+        uint index = entry & 0xFFFFu;
+        if(masked){
+            if(type == 0u)
+                result += CalcPointLight(sipkeLight(int(index)), Normal, FragPos, viewDir,Diffuse,Specular,1.0);
+        }
+        else if(type == 1u)
+            result += CalcPointLight(lightsRamovi[index], Normal, FragPos, viewDir,Diffuse,Specular,unbaked);
+        else if(type == 2u)
+            result += CalcSpotLight(spotLight[index],Normal,viewDir,FragPos,Diffuse,Specular,unbaked);
+    }
+    if(masked){
+        float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
+        if(brightness > 1.0)
+            BrightColor = vec4(result, 1.0);
+        else
+            BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+    }
+#ifdef LIGHT_HEATMAP
+    // blue for an empty cluster to red for a full one
+    float load = clamp(float(count) / float(MAX_LIGHTS_PER_CLUSTER) * 4.0, 0.0, 1.0);
+    vec3 heat = load < 0.5 ? mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), load * 2.0)
+                           : mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), load * 2.0 - 1.0);
+    result = mix(result, heat, 0.6);
+    BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
+    FragColor = vec4(result, 1.0);
+    float depth = LinearizeDepth(gl_FragCoord.z) / far; // divide by far for demonstration
+    Depth = vec4(vec3(depth), 1.0);
+#else
+    if(maska == vec3(1.0,1.0,1.0)){
+        for(int i = 0; i < sipkeLightCount; ++i){
+                result +=CalcPointLight(sipkeLight(i), Normal, FragPos, viewDir,Diffuse,Specular,1.0);
             }
                 float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
                 if(brightness > 1.0)
@@ -196,11 +345,11 @@ void main()
                 Depth = vec4(vec3(depth), 1.0);
     }
     else{
-        for(int i = 0; i < NR_LIGHTS_RAMOVI; ++i){
-            result +=CalcPointLight(lightsRamovi[i], Normal, FragPos, viewDir,Diffuse,Specular);
+        for(int i = 0; i < ramoviLightCount; ++i){
+            result +=CalcPointLight(lightsRamovi[i], Normal, FragPos, viewDir,Diffuse,Specular,unbaked);
         }
-        for(int i= 0; i < NR_SPOT_LIGHTS; i++){
-            result += CalcSpotLight(spotLight[i],Normal,viewDir,FragPos,Diffuse,Specular);
+        for(int i= 0; i < spotLightCount; i++){
+            result += CalcSpotLight(spotLight[i],Normal,viewDir,FragPos,Diffuse,Specular,unbaked);
         }
 
 
@@ -210,5 +359,5 @@ void main()
             Depth = vec4(vec3(depth), 1.0);
 
     }
-
+#endif
 }
\ No newline at end of file
@@ -4,6 +4,7 @@ layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedoSpec;
 layout (location = 3) out vec4 gDepth;
 layout (location = 4) out vec4 gMask;
+layout (location = 5) out vec4 gBaked;
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
@@ -31,5 +32,7 @@ void main()
     float depth = LinearizeDepth(gl_FragCoord.z) / far; // divide by far for demonstration
     gDepth = vec4(vec3(depth), 1.0);
     gMask = vec4(1.0,1.0,1.0,1.0);
+    // the tunnel is lit dynamically
+    gBaked = vec4(0.0);
 
 }
\ No newline at end of file
@@ -9,8 +9,22 @@ out vec2 TexCoords;
 out vec3 Normal;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// written once a frame into a ring of uniform buffers, FrameConstants in uniform_ring.h mirrors it (std140)
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+layout (std140, binding = 0) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float time;
+    DirLight dirLight;
+    float exposure;
+    vec3 sipkeColor;
+};
 
 void main()
 {
@@ -4,12 +4,21 @@ layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedoSpec;
 layout (location = 3) out vec4 gDepth;
 layout (location = 4) out vec4 gMask;
+// baked ambient and diffuse light of the frame and spot lights (lightmap_baker), alpha 1 where it covers
+layout (location = 5) out vec4 gBaked;
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
+in vec2 LightmapCoords;
+flat in int DiffuseLayer;
 
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
+uniform sampler2DArray diffuseArray;
+uniform bool useDiffuseArray;
+uniform sampler2D lightmap;
+// off while there is no lightmap or the lights moved since it was baked
+uniform bool useLightmap;
 float near = 0.1;
 float far  = 100.0;
 
@@ -25,10 +34,14 @@ void main()
     // also store the per-fragment normals into the gbuffer
     gNormal = normalize(Normal);
     // and the diffuse per-fragment color
-    gAlbedoSpec.rgb = texture(texture_diffuse1, TexCoords).rgb;
+    if (useDiffuseArray)
+        gAlbedoSpec.rgb = texture(diffuseArray, vec3(TexCoords, DiffuseLayer)).rgb;
+    else
+        gAlbedoSpec.rgb = texture(texture_diffuse1, TexCoords).rgb;
     // store specular intensity in gAlbedoSpec's alpha component
     gAlbedoSpec.a = texture(texture_specular1, TexCoords).r;
     float depth = LinearizeDepth(gl_FragCoord.z) / far; // divide by far for demonstration
     gDepth = vec4(vec3(depth), 1.0);
     gMask = vec4(0.5,0.5,0.5,1.0);
+    gBaked = useLightmap ? texture(lightmap, LightmapCoords) : vec4(0.0);
 }
\ No newline at end of file
@@ -2,23 +2,43 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in vec2 aLightmapCoords;
 
 out vec3 FragPos;
 out vec2 TexCoords;
 out vec3 Normal;
+out vec2 LightmapCoords;
+// layer of the diffuse texture array, MaterialArray puts it in each indirect command's baseInstance
+flat out int DiffuseLayer;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// written once a frame into a ring of uniform buffers, FrameConstants in uniform_ring.h mirrors it (std140)
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+layout (std140, binding = 0) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float time;
+    DirLight dirLight;
+    float exposure;
+    vec3 sipkeColor;
+};
 
 void main()
 {
     vec4 worldPos = model * vec4(aPos, 1.0);
     FragPos = worldPos.xyz;
     TexCoords = aTexCoords;
+    LightmapCoords = aLightmapCoords;
 
     mat3 normalMatrix = transpose(inverse(mat3(model)));
     Normal = normalMatrix * aNormal;
+    DiffuseLayer = gl_BaseInstance;
 
     gl_Position = projection * view * worldPos;
 }
\ No newline at end of file
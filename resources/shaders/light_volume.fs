@@ -0,0 +1,219 @@
+#version 460 core
+// the light of one volume of LightVolumes (light_volumes.h), added to what the lighting pass wrote
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
+layout (location = 2) out vec4 Depth;
+
+flat in int lightIndex;
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gMask;
+// the frames' baked light (lightmap_baker), the lighting pass has added it already
+uniform sampler2D gBaked;
+
+// written once a frame into a ring of uniform buffers, FrameConstants in uniform_ring.h mirrors it (std140)
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+layout (std140, binding = 0) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float time;
+    DirLight dirLight;
+    float exposure;
+    vec3 sipkeColor;
+};
+
+// the same std430 light structs as in 8.1.deferred_shading.fs
+struct pointLight {
+    vec3 position;
+    float constant;
+    vec3 color;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float radius;
+    vec3 specular;
+};
+struct SpotLight{
+   vec3 position;
+   float cutOff;
+   vec3 direction;
+   float outerCutOff;
+   vec3 ambient;
+   float constant;
+   vec3 diffuse;
+   float linear;
+   vec3 specular;
+   float quadratic;
+   float radius;
+   int shadow;
+};
+
+layout (std430, binding = 0) readonly buffer SipkeLights {
+    pointLight lightsSipke[];
+};
+layout (std430, binding = 1) readonly buffer RamoviLights {
+    pointLight lightsRamovi[];
+};
+layout (std430, binding = 2) readonly buffer SpotLights {
+    SpotLight spotLight[];
+};
+// with the shared color from the frame constants, as in 8.1.deferred_shading.fs
+pointLight sipkeLight(int index)
+{
+    pointLight light = lightsSipke[index];
+    light.color = sipkeColor;
+    return light;
+}
+// the spot lights' shadow maps, tiles of one atlas (ShadowAtlas in shadow_atlas.h); matrix goes from world
+// space to the tile's texture coordinates and depth, bounds is the tile's texture rectangle
+struct ShadowTile {
+    mat4 matrix;
+    vec4 bounds;
+};
+layout (std430, binding = 5) readonly buffer ShadowTiles {
+    ShadowTile shadowTiles[];
+};
+uniform sampler2DShadow shadowAtlas;
+// 0 sipke, 1 ramovi, 2 spot
+uniform int lightSet;
+
+#ifdef UNIFORM_BRANCHES
+uniform bool blinn;
+#elif defined(BLINN)
+const bool blinn = true;
+#else
+const bool blinn = false;
+#endif
+
+// fades the attenuation to zero at the light's radius (LightRadius in light_buffer.h), where it is culled
+float radiusWindow(float distance, float radius)
+{
+    float ratio = distance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window;
+}
+
+// calculates the color when using a point light; unbaked is 0 where the lightmap already holds its ambient and diffuse part
+vec3 CalcPointLight(pointLight light, vec3 normal, vec3 fragPos, vec3 viewDir,vec3 Diffuse,float Specular,float unbaked)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    float spec = 0.0;
+    if(blinn)
+    {
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    }
+    else
+    {
+        vec3 reflectDir = reflect(-lightDir, normal);
+        spec = pow(max(dot(viewDir, reflectDir), 0.0), 8.0);
+    }
+
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= radiusWindow(distance, light.radius);
+    // combine results
+    vec3 ambient = light.ambient * Diffuse;
+    vec3 diffuse = light.diffuse * diff * Diffuse * light.color;
+    vec3 specular = light.specular * spec * Specular;
+    ambient *= attenuation * unbaked;
+    diffuse *= attenuation * unbaked;
+    specular *= attenuation;
+    return (ambient + diffuse + specular);
+}
+
+// 1 lit, 0 in shadow, filtered by the depth compare; the position is pushed off the surface along its normal
+float SpotShadow(int shadow, vec3 fragPos, vec3 normal)
+{
+    if (shadow < 0)
+        return 1.0;
+    ShadowTile tile = shadowTiles[shadow];
+    vec4 clip = tile.matrix * vec4(fragPos + normal * 0.03, 1.0);
+    if (clip.w <= 0.0)
+        return 1.0;
+    vec3 coord = clip.xyz / clip.w;
+    if (any(lessThan(coord.xy, tile.bounds.xy)) || any(greaterThan(coord.xy, tile.bounds.zw)) || coord.z > 1.0)
+        return 1.0;
+    return texture(shadowAtlas, vec3(coord.xy, coord.z - 0.0005));
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal,vec3 viewDir,vec3 fragPos,vec3 Diffuse,float Specular,float unbaked){
+    vec3 lightDir = normalize(light.position -fragPos);
+
+    float diff = max(dot(normal, lightDir),0.0);
+    //blinn?
+    float spec = 0.0;
+    if(blinn)
+    {
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    }
+    else
+    {
+        vec3 reflectDir = reflect(-lightDir, normal);
+        spec = pow(max(dot(viewDir, reflectDir), 0.0), 8.0);
+    }
+
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    attenuation *= radiusWindow(distance, light.radius);
+
+    float epsilon = light.cutOff - light.outerCutOff;
+    float theta = dot(-lightDir,normalize(light.direction));
+    float intensity = clamp((theta - light.outerCutOff) / epsilon,0.0,1.0);
+
+    vec3 ambient = light.ambient * Diffuse;
+    vec3 diffuse = light.diffuse * diff * Diffuse;
+    vec3 specular = light.specular * spec * Specular;
+
+
+    ambient *= attenuation * unbaked;
+    float shadow = SpotShadow(light.shadow, fragPos, normal);
+    diffuse*= attenuation* intensity * shadow * unbaked;
+    specular *= attenuation * intensity * shadow;
+
+
+    return (ambient + diffuse + specular);
+
+}
+
+void main()
+{
+    vec2 TexCoords = gl_FragCoord.xy / vec2(textureSize(gPosition, 0));
+    vec3 FragPos = texture(gPosition, TexCoords).rgb;
+    vec3 Normal = texture(gNormal, TexCoords).rgb;
+    vec3 Diffuse = texture(gAlbedoSpec, TexCoords).rgb;
+    float Specular = texture(gAlbedoSpec, TexCoords).a;
+    vec3 viewDir = normalize(FragPos - viewPos);
+
+    // like the fullscreen pass: the sipke lights light the masked pixels, the others the rest
+    bool masked = texture(gMask, TexCoords).rgb == vec3(1.0, 1.0, 1.0);
+    if (masked != (lightSet == 0))
+        discard;
+    float unbaked = 1.0 - texture(gBaked, TexCoords).a;
+    vec3 result;
+    if (lightSet == 0)
+        result = CalcPointLight(sipkeLight(lightIndex), Normal, FragPos, viewDir, Diffuse, Specular, 1.0);
+    else if (lightSet == 1)
+        result = CalcPointLight(lightsRamovi[lightIndex], Normal, FragPos, viewDir, Diffuse, Specular, unbaked);
+    else
+        result = CalcSpotLight(spotLight[lightIndex], Normal, viewDir, FragPos, Diffuse, Specular, unbaked);
+
+    // blended with GL_ONE, GL_ONE: the bloom input gets the masked pixels' light, the depth view stays as it is
+    FragColor = vec4(result, 0.0);
+    BrightColor = masked ? vec4(result, 0.0) : vec4(0.0);
+    Depth = vec4(0.0);
+}
@@ -0,0 +1,85 @@
+#version 460 core
+// one instance per light of the set, the unit sphere or cone of LightVolumes (light_volumes.h) placed and
+// scaled to the light's radius
+layout (location = 0) in vec3 aPos;
+
+// written once a frame into a ring of uniform buffers, FrameConstants in uniform_ring.h mirrors it (std140)
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+layout (std140, binding = 0) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float time;
+    DirLight dirLight;
+    float exposure;
+    vec3 sipkeColor;
+};
+
+// the same std430 light structs as in 8.1.deferred_shading.fs
+struct pointLight {
+    vec3 position;
+    float constant;
+    vec3 color;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float radius;
+    vec3 specular;
+};
+struct SpotLight{
+   vec3 position;
+   float cutOff;
+   vec3 direction;
+   float outerCutOff;
+   vec3 ambient;
+   float constant;
+   vec3 diffuse;
+   float linear;
+   vec3 specular;
+   float quadratic;
+   float radius;
+   int shadow;
+};
+
+layout (std430, binding = 0) readonly buffer SipkeLights {
+    pointLight lightsSipke[];
+};
+layout (std430, binding = 1) readonly buffer RamoviLights {
+    pointLight lightsRamovi[];
+};
+layout (std430, binding = 2) readonly buffer SpotLights {
+    SpotLight spotLight[];
+};
+// 0 sipke, 1 ramovi, 2 spot
+uniform int lightSet;
+
+flat out int lightIndex;
+
+void main()
+{
+    lightIndex = gl_InstanceID;
+    vec3 worldPos;
+    if (lightSet == 2)
+    {
+        // the cone's base is as wide as the outer cutoff at the light's radius
+        SpotLight light = spotLight[gl_InstanceID];
+        float spread = sqrt(max(1.0 - light.outerCutOff * light.outerCutOff, 0.0)) / max(light.outerCutOff, 0.001);
+        vec3 forward = normalize(light.direction);
+        vec3 up = abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+        vec3 right = normalize(cross(up, forward));
+        up = cross(forward, right);
+        worldPos = light.position + (right * aPos.x * spread + up * aPos.y * spread + forward * aPos.z) * light.radius;
+    }
+    else
+    {
+        pointLight light = lightSet == 0 ? lightsSipke[gl_InstanceID] : lightsRamovi[gl_InstanceID];
+        worldPos = light.position + aPos * light.radius;
+    }
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+}
@@ -0,0 +1,6 @@
+#version 460 core
+
+// depth only, the atlas has no color attachment
+void main()
+{
+}
@@ -0,0 +1,11 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+
+// a spot light's shadow tile, rendered into the shadow atlas (ShadowAtlas in shadow_atlas.h)
+uniform mat4 lightSpace;
+uniform mat4 model;
+
+void main()
+{
+    gl_Position = lightSpace * model * vec4(aPos, 1.0);
+}
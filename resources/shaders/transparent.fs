@@ -21,12 +21,22 @@ struct PointLight{
     vec3 diffuse;
     vec3 specular;
 };
-struct DirLight{
+// written once a frame into a ring of uniform buffers, FrameConstants in uniform_ring.h mirrors it (std140)
+struct DirLight {
     vec3 direction;
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
 };
+layout (std140, binding = 0) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float time;
+    DirLight dirLight;
+    float exposure;
+    vec3 sipkeColor;
+};
 struct SpotLight{
    float constant;
    float linear;
@@ -47,12 +57,16 @@ struct SpotLight{
 uniform sampler2D tekstura;
 
 uniform Material material;
-uniform DirLight dirLight;
 uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight[NR_SPOT_LIGHTS];
 
-uniform vec3 viewPos;
+#ifdef UNIFORM_BRANCHES
 uniform bool blinn;
+#elif defined(BLINN)
+const bool blinn = true;
+#else
+const bool blinn = false;
+#endif
 
 
 
@@ -175,7 +189,10 @@ void main(){
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
 //     vec3 result = vec3(0.0);
-    vec3 result = CalcDirLight(dirLight,norm,viewDir);
+    // the plane is lit five times brighter by the sun than the rest of the scene
+    DirLight sun = dirLight;
+    sun.diffuse *= 5.0;
+    vec3 result = CalcDirLight(sun,norm,viewDir);
 //
 //     for(int i= 0; i < NR_POINT_LIGHTS; i++){
 //         result += CalcPointLight(pointLights[i],norm,viewDir,FragPos);
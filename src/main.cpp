@@ -9,12 +9,33 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#define HEAP_COUNTER_IMPLEMENTATION
+#include <learnopengl/heap_counter.h>
+
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
+#include <learnopengl/frame_arena.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/light_buffer.h>
+#include <learnopengl/light_clusters.h>
+#include <learnopengl/light_volumes.h>
+#include <learnopengl/lightmap.h>
+#include <learnopengl/material_array.h>
 #include <learnopengl/model.h>
-
+#include <learnopengl/render_queue.h>
+#include <learnopengl/shader_manager.h>
+#include <learnopengl/shadow_atlas.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/texture_streamer.h>
+#include <learnopengl/uniform_ring.h>
+
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -70,6 +91,19 @@ struct SpotLight {
     float cutOff;
     float outerCutOff;
 };
+// keys of the shader variants: the family's feature (BLINN or BLOOM) compiled in, or the reference
+// variant that keeps branching on a uniform. The lit shaders turn BLINN into a const bool blinn that picks the
+// specular model at compile time; with UNIFORM_BRANCHES blinn stays the old runtime uniform, for comparison
+const unsigned int VARIANT_FEATURE = 1u << 0;
+const unsigned int VARIANT_UNIFORM_BRANCHES = 1u << 1;
+// lighting pass only: loop over the light list of the fragment's cluster, and show how long those lists are
+const unsigned int VARIANT_CLUSTERED = 1u << 2;
+const unsigned int VARIANT_LIGHT_HEATMAP = 1u << 3;
+// lighting pass over every light: the light counts are uniforms, only the visible lights are in the buffers
+const unsigned int VARIANT_CULLED_LIGHTS = 1u << 4;
+// lighting pass of the sun only, the other lights are drawn as volumes after it
+const unsigned int VARIANT_LIGHT_VOLUMES = 1u << 5;
+
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
     bool ImGuiEnabled = false;
@@ -95,6 +129,36 @@ struct ProgramState {
     float planePosY = -3.228f;
     float planePosZ = -10.663f;
     glm::vec3 planePos = glm::vec3(5,planeScaleY,planePosZ);
+    bool textureStreaming = true;
+    int textureBudgetMB = 256;
+    // nothing reads the vertices back after upload, so the CPU copies are dropped once the models are loaded
+    bool releaseCpuGeometry = true;
+    // each model in one vertex/index buffer, so drawing it binds a single VAO
+    bool packGeometry = true;
+    // the same sized paintings in one texture array, drawn with a single indirect multi-draw
+    bool materialArray = true;
+    // set the lighting uniforms through precomputed handles instead of building their names every frame
+    bool uniformHandles = true;
+    // draw with the shader variants that still branch on blinn/bloom uniforms, to compare their GPU time
+    bool uniformBranches = false;
+    // drop the binds and enables that would set what is already set
+    bool filterGLState = true;
+    // record the geometry pass into a sort-keyed queue instead of drawing the models in node order
+    bool renderQueue = true;
+    // light the pixels with the lights of their cluster only, the lists are built by a compute pass
+    bool clusteredLighting = true;
+    bool lightHeatmap = false;
+    // how much a light may still add where it is cut off, sets the radius it is culled with
+    float lightCutoff = 0.05f;
+    // send the shaders only the lights whose radius reaches into the view frustum
+    bool cullLights = true;
+    // draw the point and spot lights as stencil tested spheres and cones instead of over the whole screen
+    bool lightVolumes = false;
+    // the spot lights' shadows, cached in an atlas; at most this many tiles are rendered again a frame
+    bool spotShadows = true;
+    int shadowRefreshBudget = 4;
+    // the frames' ambient and diffuse light from the lightmap (lightmap_baker), while it matches the lights
+    bool bakedLighting = true;
 
     PointLight pointLight;
     SpotLight spotLight;
@@ -154,7 +218,14 @@ void ProgramState::LoadFromFile(std::string filename) {
 ProgramState *programState;
 
 
-int main() {
+// --allocation-test: after the warm-up frames every frame has to get by without the heap, the run ends
+// after the measured frames and fails when one of them allocated
+const int ALLOCATION_TEST_WARMUP_FRAMES = 120;
+const int ALLOCATION_TEST_FRAMES = 240;
+
+int main(int argc, char **argv) {
+    bool allocationTest = argc > 1 && std::strcmp(argv[1], "--allocation-test") == 0;
+    auto startupStart = std::chrono::steady_clock::now();
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -188,6 +259,7 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    GLExtensions::Get().Load((GLADloadproc) glfwGetProcAddress);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
@@ -199,6 +271,7 @@ int main() {
     }
     // Init Imgui
     IMGUI_CHECKVERSION();
+    ImGui::SetAllocatorFunctions(HeapCounter::ImGuiAlloc, HeapCounter::ImGuiFree);
     ImGui::CreateContext();
     ImGuiIO &io = ImGui::GetIO();
     (void) io;
@@ -210,24 +283,61 @@ int main() {
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    GLState::Get().Enable(GL_DEPTH_TEST);
+    GLState::Get().Enable(GL_CULL_FACE);
+
+    // cooked painting textures start out small, the streamer brings in finer mips as the camera gets close
+    TextureStreamer textureStreamer;
+    if (programState->textureStreaming)
+        TextureLoader::Instance().cookedInitialSize = 256;
 
     // build and compile shaders
     // -------------------------
-    Shader shaderGeometryPass("resources/shaders/8.1.g_buffer.vs", "resources/shaders/8.1.g_buffer.fs");
-    Shader shaderGeometryPass2("resources/shaders/gBuffer2.vs", "resources/shaders/gBuffer2.fs");
-    Shader shaderLightingPass("resources/shaders/8.1.deferred_shading.vs", "resources/shaders/8.1.deferred_shading.fs");
-    Shader shaderBloomFinal("resources/shaders/7.bloom_final.vs", "resources/shaders/7.bloom_final.fs");
-    Shader shaderBlur("resources/shaders/blur.vs", "resources/shaders/blur.fs");
-    Shader transparentShader("resources/shaders/transparent.vs", "resources/shaders/transparent.fs");
+    // every program is submitted at once and compiles on the driver's threads while the models load
+    ShaderManager shaders;
+    Shader shaderGeometryPass("resources/shaders/8.1.g_buffer.vs", "resources/shaders/8.1.g_buffer.fs", nullptr, false);
+    Shader shaderGeometryPass2("resources/shaders/gBuffer2.vs", "resources/shaders/gBuffer2.fs", nullptr, false);
+    Shader shaderBlur("resources/shaders/blur.vs", "resources/shaders/blur.fs", nullptr, false);
+    Shader shadowDepth("resources/shaders/shadow_depth.vs", "resources/shaders/shadow_depth.fs", nullptr, false);
+    for (Shader *shader : {&shaderGeometryPass, &shaderGeometryPass2, &shaderBlur, &shadowDepth})
+        shaders.Add(*shader);
+    // the blinn and bloom switches select prebuilt variants instead of branching in every fragment
+    ShaderVariants bloomFinals(shaders, "resources/shaders/7.bloom_final.vs", "resources/shaders/7.bloom_final.fs",
+                               {"BLOOM", "UNIFORM_BRANCHES"});
+    ShaderVariants transparentShaders(shaders, "resources/shaders/transparent.vs", "resources/shaders/transparent.fs",
+                                      {"BLINN", "UNIFORM_BRANCHES"});
+    bloomFinals.Prebuild({0, VARIANT_FEATURE, VARIANT_UNIFORM_BRANCHES});
+    transparentShaders.Prebuild({0, VARIANT_FEATURE, VARIANT_UNIFORM_BRANCHES});
+    // the geometry pass shaders are needed first, the models upload only the vertex attributes they read
+    shaders.Wait(shaderGeometryPass);
+    shaders.Wait(shaderGeometryPass2);
 
     // load models
     // -----------
-    Model tunel2("resources/objects/final/sipke2.obj");
+    // the models only queue their textures here, the images decode on worker threads
+    // while the shaders and framebuffers below are built. Whatever has decoded is uploaded after
+    // each model, the loader only holds a few decoded images at a time (maxReadyImages)
+    ModelOptions modelOptions;
+    modelOptions.releaseCpuGeometry = programState->releaseCpuGeometry;
+    modelOptions.packGeometry = programState->packGeometry;
+    modelOptions.vertexFormat = VertexFormat::ForProgram(shaderGeometryPass.ID);
+    Model tunel2("resources/objects/final/sipke2.obj", modelOptions);
     tunel2.SetShaderTextureNamePrefix("");
-    Model ramovi2("resources/objects/final/ramovi2.obj");
+    TextureLoader::Instance().Process();
+    modelOptions.vertexFormat = VertexFormat::ForProgram(shaderGeometryPass2.ID);
+    // the frames are lit by static lights, their baked light comes with vertices split along the lightmap's seams
+    const std::string galleryPath = "resources/objects/final/ramovi2.obj";
+    Lightmap galleryLightmap;
+    if (galleryLightmap.Open(Lightmap::PathFor(galleryPath)))
+        modelOptions.lightmap = &galleryLightmap;
+    Model ramovi2(galleryPath, modelOptions);
     ramovi2.SetShaderTextureNamePrefix("");
+    modelOptions.lightmap = nullptr;
+    TextureLoader::Instance().Process();
+    if (galleryLightmap.IsOpen())
+        galleryLightmap.Upload();
+    std::cout << "GEOMETRY::HEAP peak " << GeometryStats::Get().peakBytes / (1024.0 * 1024.0) << " MB, steady "
+              << GeometryStats::Get().currentBytes / (1024.0 * 1024.0) << " MB" << std::endl;
 
     unsigned int transparentTexture = loadTexture("resources/textures/plocice3.png",false);
 
@@ -331,7 +441,7 @@ int main() {
     unsigned int transparentVAO, transparentVBO;
     glGenVertexArrays(1, &transparentVAO);
     glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
+    GLState::Get().BindVertexArray(transparentVAO);
     glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), transparentVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -346,17 +456,17 @@ int main() {
     //BAFFERI
     unsigned int gBuffer;
     glGenFramebuffers(1, &gBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-    unsigned int gPosition, gNormal, gAlbedoSpec, gDepth,gMask;
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    unsigned int gPosition, gNormal, gAlbedoSpec, gDepth,gMask,gBaked;
     glGenTextures(1, &gPosition);
-    glBindTexture(GL_TEXTURE_2D, gPosition);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gPosition);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
 // normal color buffer
     glGenTextures(1, &gNormal);
-    glBindTexture(GL_TEXTURE_2D, gNormal);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gNormal);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -364,14 +474,14 @@ int main() {
 
     // color + specular color buffer
     glGenTextures(1, &gAlbedoSpec);
-    glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gAlbedoSpec);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedoSpec, 0);
     //vizualizacija depth buffera
     glGenTextures(1, &gDepth);
-    glBindTexture(GL_TEXTURE_2D, gDepth);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gDepth);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -379,34 +489,43 @@ int main() {
 
     //maska
     glGenTextures(1, &gMask);
-    glBindTexture(GL_TEXTURE_2D, gMask);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gMask);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, gMask, 0);
 
+    // baked light of the frames, sampled from the lightmap; alpha tells the lighting pass where it covers
+    glGenTextures(1, &gBaked);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gBaked);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT5, GL_TEXTURE_2D, gBaked, 0);
+
     // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
-    unsigned int attachments[5] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 , GL_COLOR_ATTACHMENT4 };
-    glDrawBuffers(5, attachments);
+    unsigned int attachments[6] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 , GL_COLOR_ATTACHMENT4, GL_COLOR_ATTACHMENT5 };
+    glDrawBuffers(6, attachments);
     // create and attach depth buffer (renderbuffer)
     unsigned int rboDepth;
     glGenRenderbuffers(1, &rboDepth);
     glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+    // with stencil, in the same format as hdrFBO's so the light volumes can be tested against a copy of it
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
     // finally check if framebuffer is complete
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
     unsigned int hdrFBO;
     glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
     // create 2 floating point color buffers (1 for normal rendering, other for brightness threshold values)
     unsigned int colorBuffers[3];
     glGenTextures(3, colorBuffers);
     for (unsigned int i = 0; i < 3; i++)
     {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, colorBuffers[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -421,11 +540,11 @@ int main() {
     unsigned int rboDepth2;
     glGenRenderbuffers(1, &rboDepth2);
     glBindRenderbuffer(GL_RENDERBUFFER, rboDepth2);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth2);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth2);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // ping-pong-framebuffer for blurring
     unsigned int pingpongFBO[2];
@@ -437,8 +556,8 @@ int main() {
     glGenTextures(2, pingpongDepthbuffers);
     for (unsigned int i = 0; i < 2; i++)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -447,7 +566,7 @@ int main() {
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
 
 
-        glBindTexture(GL_TEXTURE_2D, pingpongDepthbuffers[i]);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, pingpongDepthbuffers[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT, 0,GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -460,12 +579,12 @@ int main() {
     }
     unsigned int hdrFBO1;
     glGenFramebuffers(1, &hdrFBO1);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO1);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, hdrFBO1);
     // create 2 floating point color buffers (1 for normal rendering, other for brightness threshold values)
     unsigned int colorBuffers1;
     glGenTextures(1, &colorBuffers1);
 
-        glBindTexture(GL_TEXTURE_2D, colorBuffers1);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, colorBuffers1);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -483,13 +602,11 @@ int main() {
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth7);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
     // lighting info
     // -------------
-    const unsigned int NR_LIGHTS = 96;
-
     std::vector<glm::vec3> lightPositions ={glm::vec3(-18.219347,0.019841,-4.418480),
                                              glm::vec3(-18.219347,8.081969,-14.856816),
                                              glm::vec3(-18.219347,5.026847,-3.111567),
@@ -587,15 +704,6 @@ int main() {
                                              glm::vec3(36.895416,-5.349567,-2.314456),
                                              glm::vec3(37.014977,0.177408,-3.963766),
                                             };
-    std::vector<glm::vec3> lightColors;
-    srand(13);
-    for (unsigned int i = 0; i < NR_LIGHTS; i++)
-    {
-        float rColor = 0.0f; // between 0.5 and 1.0
-        float gColor = 0.0f; // between 0.5 and 1.0
-        float bColor = 0.0f; // between 0.5 and 1.0
-        lightColors.push_back(glm::vec3(rColor, gColor, bColor));
-    }
     std::vector<glm::vec3> lightPositions2={glm::vec3(28.796471,2.201056,-11.214249),
                                             glm::vec3(-9.926498,2.308139,-11.444411),
                                             glm::vec3(-1.413528,2.552329,-11.210718),
@@ -607,22 +715,304 @@ int main() {
 
 
 
-    // shader configuration
+    // the light counts are compiled into the lighting pass, its variants build while the textures upload
+    std::vector<std::string> lightDefines = {"SIPKE_LIGHTS " + std::to_string(lightPositions.size()),
+                                             "RAMOVI_LIGHTS " + std::to_string(lightPositions2.size()),
+                                             "SPOT_LIGHTS " + std::to_string(spotLightPositions.size())};
+    for (const std::string &define : LightClusters::Defines())
+        lightDefines.push_back(define);
+    ShaderVariants lightingPasses(shaders, "resources/shaders/8.1.deferred_shading.vs", "resources/shaders/8.1.deferred_shading.fs",
+                                  {"BLINN", "UNIFORM_BRANCHES", "CLUSTERED", "LIGHT_HEATMAP", "CULLED_LIGHTS", "LIGHT_VOLUMES"},
+                                  lightDefines);
+    lightingPasses.Prebuild({0, VARIANT_FEATURE, VARIANT_UNIFORM_BRANCHES, VARIANT_CULLED_LIGHTS,
+                             VARIANT_FEATURE | VARIANT_CULLED_LIGHTS, VARIANT_LIGHT_VOLUMES,
+                             VARIANT_FEATURE | VARIANT_LIGHT_VOLUMES});
+    ShaderVariants lightVolumeShaders(shaders, "resources/shaders/light_volume.vs", "resources/shaders/light_volume.fs",
+                                      {"BLINN", "UNIFORM_BRANCHES"});
+    lightVolumeShaders.Prebuild({0, VARIANT_FEATURE, VARIANT_UNIFORM_BRANCHES});
+    // the light lists of the clustered variants come from a compute pass, which needs GL 4.3
+    if (!LightClusters::Supported())
+        programState->clusteredLighting = false;
+    std::unique_ptr<Shader> lightCulling;
+    LightClusters clusters;
+    if (LightClusters::Supported()) {
+        lightingPasses.Prebuild({VARIANT_CLUSTERED, VARIANT_FEATURE | VARIANT_CLUSTERED});
+        lightCulling.reset(new Shader(Shader::Compute(), "resources/shaders/light_culling.comp", lightDefines, false));
+        shaders.Add(*lightCulling);
+        clusters.Create();
+    }
+
+    // upload the model textures that were decoding in the background
+    TextureLoader::Instance().Finish();
+    TextureCache::Instance().Report();
+    // the paintings share gBuffer2 and differ only in their diffuse map
+    MaterialArray paintings;
+    if (programState->materialArray)
+        paintings.Build(ramovi2, "ramovi2", (size_t)programState->textureBudgetMB * 1024 * 1024);
+    // past the units of the mesh materials and the texture array
+    const unsigned int LIGHTMAP_UNIT = 9;
+    shaders.OnLink(shaderGeometryPass2, [](Shader &shader) {
+        shader.use();
+        shader.setInt("diffuseArray", MaterialArray::TEXTURE_UNIT);
+        shader.setBool("useDiffuseArray", false);
+        shader.setInt("lightmap", LIGHTMAP_UNIT);
+        shader.setBool("useLightmap", false);
+    });
+    if (programState->textureStreaming) {
+        textureStreamer.AddMeshes(tunel2.meshes);
+        // the array keeps its own copy of those, streaming the 2D textures would only cost uploads
+        textureStreamer.AddMeshes(ramovi2.meshes, paintings.Textures());
+    }
+
+    // whatever is still compiling is needed from here on
+    shaders.WaitAll();
+
+    // shader configuration, repeated whenever a program is reloaded
     // --------------------
-    shaderLightingPass.use();
-    shaderLightingPass.setInt("gPosition", 0);
-    shaderLightingPass.setInt("gNormal", 1);
-    shaderLightingPass.setInt("gAlbedoSpec", 2);
-    shaderLightingPass.setInt("gMask", 3);
+    auto variantKey = [&](bool feature) {
+        return programState->uniformBranches ? VARIANT_UNIFORM_BRANCHES : feature ? VARIANT_FEATURE : 0u;
+    };
+    // where the lighting pass gets its lights from: the volumes drawn after it, the cluster lists, the frustum
+    // culled buffers or all of them
+    auto lightListKey = [&]() {
+        if (programState->lightVolumes)
+            return VARIANT_LIGHT_VOLUMES;
+        if (programState->clusteredLighting)
+            return VARIANT_CLUSTERED | (programState->lightHeatmap ? VARIANT_LIGHT_HEATMAP : 0u);
+        return programState->cullLights ? VARIANT_CULLED_LIGHTS : 0u;
+    };
+    Shader *shaderLightingPass = &lightingPasses.Get(variantKey(programState->blinn));
+    Shader *shaderBloomFinal = &bloomFinals.Get(variantKey(programState->bloom));
+    Shader *transparentShader = &transparentShaders.Get(variantKey(programState->blinn));
+    Shader *shaderLightVolume = &lightVolumeShaders.Get(variantKey(programState->blinn));
+    lightingPasses.OnLink([](Shader &shader) {
+        shader.use();
+        shader.setInt("gPosition", 0);
+        shader.setInt("gNormal", 1);
+        shader.setInt("gAlbedoSpec", 2);
+        shader.setInt("gMask", 3);
+        shader.setInt("shadowAtlas", 4);
+        shader.setInt("gBaked", 5);
+    });
+    lightVolumeShaders.OnLink([](Shader &shader) {
+        shader.use();
+        shader.setInt("gPosition", 0);
+        shader.setInt("gNormal", 1);
+        shader.setInt("gAlbedoSpec", 2);
+        shader.setInt("gMask", 3);
+        shader.setInt("shadowAtlas", 4);
+        shader.setInt("gBaked", 5);
+    });
+    bloomFinals.OnLink([](Shader &shader) {
+        shader.use();
+        shader.setInt("scene", 0);
+        shader.setInt("bloomBlur", 1);
+        shader.setInt("maska", 2);
+    });
+    shaders.OnLink(shaderBlur, [](Shader &shader) {
+        shader.use();
+        shader.setInt("image", 0);
+    });
+    transparentShaders.OnLink([](Shader &shader) {
+        shader.use();
+        shader.setInt("tekstura", 0);
+    });
+
+    // the lights themselves live in shader storage buffers, bound to the points the shader declares
+    const unsigned int SIPKE_LIGHTS_BINDING = 0, RAMOVI_LIGHTS_BINDING = 1, SPOT_LIGHTS_BINDING = 2;
+    LightBuffer<GpuPointLight> sipkeLights, ramoviLights;
+    LightBuffer<GpuSpotLight> spotLights;
+    sipkeLights.Create("sipke", lightPositions.size());
+    ramoviLights.Create("ramovi", lightPositions2.size());
+    spotLights.Create("spot", spotLightPositions.size());
+    LightVolumes lightVolumes;
+    lightVolumes.Create();
+    // the spot lights and the gallery don't move, their shadow maps are rendered once and kept
+    const unsigned int SHADOW_ATLAS_UNIT = 4, SHADOW_TILES_BINDING = 5;
+    ShadowAtlas shadowAtlas;
+    shadowAtlas.Create(spotLightPositions.size(), 2048);
+    // fragments the fullscreen lighting pass shaded, to hold against those of the volumes
+    GpuFragmentCounter fullscreenFragments;
+    // camera, sun and exposure, shared by every program through the FrameConstants block
+    UniformRing<FrameConstants> frameConstants;
+    frameConstants.Create("frame constants");
+    // rebuilt every frame from the current settings, only lights whose bytes changed are uploaded. Each light
+    // gets the radius where it falls below the cutoff; when culling, the lights whose sphere is outside the
+    // frustum are left out and the rest packed to the front of their buffer
+    unsigned int visibleLights = 0;
+    // also the far plane of the spot lights' shadow maps
+    auto spotRadius = [&]() {
+        const SpotLight &light = programState->spotLight;
+        return LightRadius(light.constant, light.linear, light.quadratic, light.ambient + light.diffuse + light.specular,
+                           programState->lightCutoff);
+    };
+    auto updateLightBuffers = [&](const Frustum &frustum, bool cull) {
+        float cutoff = programState->lightCutoff;
+        unsigned int visible = 0;
+        GpuPointLight point = {};
+        point.ambient = pointLight.ambient;
+        point.diffuse = pointLight.diffuse;
+        point.specular = pointLight.specular;
+        point.constant = pointLight.constant;
+        point.linear = pointLight.linear;
+        point.quadratic = pointLight.quadratic;
+        // the sipke lights' color is animated and goes through FrameConstants; their records stay white, which
+        // is also the brightest the color gets, so the radius holds for all of it
+        point.color = glm::vec3(1.0f);
+        for (unsigned int i = 0; i < lightPositions.size(); i++)
+        {
+            point.position = lightPositions[i];
+            point.radius = LightRadius(point.constant, point.linear, point.quadratic,
+                                       point.ambient + point.diffuse * point.color + point.specular, cutoff);
+            if (!cull || frustum.Sphere(point.position, point.radius))
+                sipkeLights.Set(visible++, point);
+        }
+        sipkeLights.SetCount(visible);
+        visibleLights = visible;
+        visible = 0;
+        point.color = programState->frameLights;
+        point.quadratic = 0.1f;
+        point.radius = LightRadius(point.constant, point.linear, point.quadratic,
+                                   point.ambient + point.diffuse * point.color + point.specular, cutoff);
+        for (unsigned int i = 0; i < lightPositions2.size(); i++)
+        {
+            point.position = lightPositions2[i];
+            if (!cull || frustum.Sphere(point.position, point.radius))
+                ramoviLights.Set(visible++, point);
+        }
+        ramoviLights.SetCount(visible);
+        visibleLights += visible;
+        visible = 0;
+        GpuSpotLight spot = {};
+        spot.ambient = programState->spotLight.ambient;
+        spot.diffuse = programState->spotLight.diffuse;
+        spot.specular = programState->spotLight.specular;
+        spot.constant = programState->spotLight.constant;
+        spot.linear = programState->spotLight.linear;
+        spot.quadratic = programState->spotLight.quadratic;
+        spot.cutOff = programState->spotLight.cutOff;
+        spot.outerCutOff = programState->spotLight.outerCutOff;
+        spot.radius = spotRadius();
+        // bounded by the sphere of its whole range, like in light_culling.comp
+        for (unsigned int i = 0; i < spotLightPositions.size(); i++)
+        {
+            spot.position = spotLightPositions[i];
+            spot.direction = spotLightDirections[i];
+            spot.shadow = programState->spotShadows ? shadowAtlas.ShadowIndex(i) : -1;
+            if (!cull || frustum.Sphere(spot.position, spot.radius))
+                spotLights.Set(visible++, spot);
+        }
+        spotLights.SetCount(visible);
+        visibleLights += visible;
+        return sipkeLights.Upload() + ramoviLights.Upload() + spotLights.Upload();
+    };
+
+    // the frame and spot lights as updateLightBuffers sets them up, for the baker and to tell whether the
+    // lightmap still matches them; fills lights again in place, so it doesn't allocate after the first call
+    auto collectStaticLights = [&](std::vector<LightmapLight> &lights) {
+        lights.clear();
+        LightmapLight light = {};
+        light.type = LIGHTMAP_POINT;
+        light.ambient = pointLight.ambient;
+        light.diffuse = pointLight.diffuse * programState->frameLights;
+        light.constant = pointLight.constant;
+        light.linear = pointLight.linear;
+        light.quadratic = 0.1f;
+        light.radius = LightRadius(light.constant, light.linear, light.quadratic,
+                                   pointLight.ambient + light.diffuse + pointLight.specular, programState->lightCutoff);
+        for (const glm::vec3 &position : lightPositions2) {
+            light.position = position;
+            lights.push_back(light);
+        }
+        const SpotLight &spot = programState->spotLight;
+        light.type = LIGHTMAP_SPOT;
+        light.ambient = spot.ambient;
+        light.diffuse = spot.diffuse;
+        light.constant = spot.constant;
+        light.linear = spot.linear;
+        light.quadratic = spot.quadratic;
+        light.radius = spotRadius();
+        light.cutOff = spot.cutOff;
+        light.outerCutOff = spot.outerCutOff;
+        for (unsigned int i = 0; i < spotLightPositions.size(); i++) {
+            light.position = spotLightPositions[i];
+            light.direction = spotLightDirections[i];
+            lights.push_back(light);
+        }
+    };
+    // lights the lightmap was baked with that no longer match, all of them when there is no lightmap
+    auto staleLights = [&](const std::vector<LightmapLight> &lights) {
+        unsigned int stale = 0;
+        for (unsigned int i = 0; i < lights.size(); i++)
+            if (i >= galleryLightmap.LightCount() ||
+                std::memcmp(&lights[i], &galleryLightmap.Light(i), sizeof(LightmapLight)) != 0)
+                stale++;
+        return stale + (galleryLightmap.LightCount() > lights.size() ? galleryLightmap.LightCount() - lights.size() : 0);
+    };
+    // the settings collectStaticLights reads, all floats; the frame loop collects and compares the lights again
+    // only when these change
+    struct StaticLightSettings {
+        PointLight point;
+        SpotLight spot;
+        glm::vec3 frameLights;
+        float cutoff;
+    };
+    auto staticLightSettings = [&]() {
+        return StaticLightSettings{pointLight, programState->spotLight, programState->frameLights,
+                                   programState->lightCutoff};
+    };
+    StaticLightSettings lastStaticSettings = staticLightSettings();
+    std::vector<LightmapLight> staticLights;
+    collectStaticLights(staticLights);
+    Lightmap::WriteLights(Lightmap::LightsPathFor(galleryPath), staticLights);
+    unsigned int staleLightCount = staleLights(staticLights);
+    if (galleryLightmap.IsOpen() && staleLightCount)
+        std::cout << "LIGHTMAP::STALE " << staleLightCount << " of " << staticLights.size()
+                  << " lights changed since the bake, the frames are lit dynamically until lightmap_baker runs again"
+                  << std::endl;
+
+    // the rest of the lighting uniforms the old way: every name is built and looked up again each frame
+    auto setLightUniformsByName = [&]() {
+        shaderLightingPass->setInt("sipkeLightCount", sipkeLights.Count());
+        shaderLightingPass->setInt("ramoviLightCount", ramoviLights.Count());
+        shaderLightingPass->setInt("spotLightCount", spotLights.Count());
+        shaderLightingPass->setFloat("material.shininess", 32.0f);
+        shaderLightingPass->setBool("blinn",programState->blinn);
+    };
 
-    shaderBloomFinal.use();
-    shaderBloomFinal.setInt("scene", 0);
-    shaderBloomFinal.setInt("bloomBlur", 1);
-    shaderBloomFinal.setInt("maska", 2);
-    shaderBlur.use();
-    shaderBlur.setInt("image", 0);
-    transparentShader.use();
-    transparentShader.setInt("tekstura", 0);
+    // and through handles resolved once here, the frame loop only makes the glUniform calls
+    Uniform<int> sipkeCountUniform = lightingPasses.uniform<int>("sipkeLightCount");
+    Uniform<int> ramoviCountUniform = lightingPasses.uniform<int>("ramoviLightCount");
+    Uniform<int> spotCountUniform = lightingPasses.uniform<int>("spotLightCount");
+    Uniform<float> shininessUniform = lightingPasses.uniform<float>("material.shininess");
+    Uniform<bool> blinnUniform = lightingPasses.uniform<bool>("blinn");
+
+    auto setLightUniformsByHandle = [&]() {
+        shaderLightingPass->set(sipkeCountUniform, (int)sipkeLights.Count());
+        shaderLightingPass->set(ramoviCountUniform, (int)ramoviLights.Count());
+        shaderLightingPass->set(spotCountUniform, (int)spotLights.Count());
+        shaderLightingPass->set(shininessUniform, 32.0f);
+        shaderLightingPass->set(blinnUniform, programState->blinn);
+    };
+
+    // microbenchmark of the two paths, the same glUniform calls reach the driver in both
+    {
+        shaderLightingPass->use();
+        auto benchmark = [](auto &&upload) {
+            const int frames = 200;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < frames; i++)
+                upload();
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+        };
+        double byName = benchmark(setLightUniformsByName);
+        double byHandle = benchmark(setLightUniformsByHandle);
+        std::cout << "UNIFORM::BENCH lighting pass uniforms: strings " << byName << " us/frame, handles " << byHandle
+                  << " us/frame (" << byName / std::max(byHandle, 0.001) << "x), "
+                  << shaderLightingPass->ActiveUniformCount() << " active uniforms" << std::endl;
+    }
+    double lightUniformUs = 0.0;
+    size_t lightUploadBytes = 0;
 
 
 
@@ -631,7 +1021,16 @@ int main() {
 
     // render loop
     // -----------
+    // transient data of one frame: the render queue's commands, the texture streamer's upload order
+    FrameArena frameArena;
+    RenderQueue renderQueue(frameArena);
+    bool firstFrame = true;
+    double averageSubmitMs = 0.0;
+    int frameIndex = 0;
+    unsigned long testAllocations = 0, worstFrameAllocations = 0;
     while (!glfwWindowShouldClose(window)) {
+        unsigned long frameStartAllocations = HeapCounter::Allocations();
+        frameArena.Reset();
         // per-frame time logic
         // --------------------
         float currentFrame = glfwGetTime();
@@ -641,116 +1040,166 @@ int main() {
         // input
         // -----
         processInput(window);
+        RenderStats::NextFrame();
+        GLState::Get().filtering = programState->filterGLState;
+        shaders.Update(currentFrame);
+        unsigned int blinnKey = variantKey(programState->blinn), bloomKey = variantKey(programState->bloom);
+        unsigned int lightingKey = blinnKey | lightListKey();
+        shaderLightingPass = &lightingPasses.Get(lightingKey);
+        shaderLightVolume = &lightVolumeShaders.Get(blinnKey);
+        shaderBloomFinal = &bloomFinals.Get(bloomKey);
+        transparentShader = &transparentShaders.Get(blinnKey);
 
         //postavljanje boje svetla
         float redValue = (sin(currentFrame + (2.0f*3.14f)/3.0f)/2.0f) +0.5f;
         float greenValue = ((sin(currentFrame + (4.0f*3.14f))) / 2.0f) +0.5f;
         float blueValue = ((sin(currentFrame + (4.0f*3.14f)/3.0f)) / 2.0f) +0.5f;
-        for(int i = 0 ; i< lightColors.size(); i++){
-            lightColors[i] =(glm::vec3(redValue,greenValue,blueValue));
-        }
+        glm::vec3 sipkeColor(redValue, greenValue, blueValue);
+
+        textureStreamer.budgetBytes = (size_t)programState->textureBudgetMB * 1024 * 1024;
+        textureStreamer.Update(programState->camera.Position, glm::radians(programState->camera.Zoom), SCR_HEIGHT, frameArena);
 
         // render
         // ------
-
-        // 1. geometry pass: render scene's geometry/color data into gbuffer
-        // -----------------------------------------------------------------
-        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        auto submitStart = std::chrono::steady_clock::now();
 
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
         glm::mat4 model = glm::mat4(1.0f);
 
-        shaderGeometryPass.use();
-        shaderGeometryPass.setMat4("projection", projection);
-        shaderGeometryPass.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0,0,0));
-        shaderGeometryPass.setMat4("model", model);
-
-        glDepthFunc(GL_LEQUAL);
-        tunel2.Draw(shaderGeometryPass);
+        // 0. shadow tiles of the spot lights that changed or were resized, a few a frame
+        // -------------------------------------------------------------------------------
+        if (programState->spotShadows) {
+            float radius = spotRadius();
+            for (unsigned int i = 0; i < spotLightPositions.size(); i++)
+                shadowAtlas.SetLight(i, {spotLightPositions[i], spotLightDirections[i],
+                                         programState->spotLight.outerCutOff, radius});
+            float focalPixels = SCR_HEIGHT / (2.0f * std::tan(glm::radians(programState->camera.Zoom) / 2.0f));
+            shadowAtlas.Update(programState->camera.Position, Frustum(projection * view), focalPixels,
+                               programState->shadowRefreshBudget, shadowDepth, [&](Shader &depth) {
+                depth.setMat4("model", glm::mat4(1.0f));
+                tunel2.DrawGeometry();
+                ramovi2.DrawGeometry();
+            });
+        }
 
+        // 1. geometry pass: render scene's geometry/color data into gbuffer
+        // -----------------------------------------------------------------
+        // the frames take their baked light only while it was baked from the lights as they are now
+        StaticLightSettings staticSettings = staticLightSettings();
+        if (std::memcmp(&staticSettings, &lastStaticSettings, sizeof(StaticLightSettings)) != 0) {
+            lastStaticSettings = staticSettings;
+            collectStaticLights(staticLights);
+            staleLightCount = staleLights(staticLights);
+        }
         shaderGeometryPass2.use();
-        shaderGeometryPass2.setMat4("projection", projection);
-        shaderGeometryPass2.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(glm::vec3(0.0f)));
-        shaderGeometryPass.setMat4("model", model);
-        ramovi2.Draw(shaderGeometryPass2);
-        glDepthFunc(GL_LESS);
-
+        shaderGeometryPass2.setBool("useLightmap", programState->bakedLighting && galleryLightmap.IsOpen() &&
+                                                   staleLightCount == 0);
+        GLState::Get().ActiveTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, galleryLightmap.Texture());
 
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, gBuffer);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-        shaderLightingPass.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, gNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, gMask);
-
-        // send light relevant uniforms
-        for (unsigned int i = 0; i < lightPositions.size(); i++)
-        {
-            shaderLightingPass.setVec3("lightsSipke[" + std::to_string(i) + "].position", lightPositions[i]);
-            shaderLightingPass.setVec3("lightsSipke[" + std::to_string(i) + "].color", lightColors[i]);
-
-            shaderLightingPass.setVec3("lightsSipke[" + std::to_string(i) + "].ambient", pointLight.ambient);
-            shaderLightingPass.setVec3("lightsSipke[" + std::to_string(i) + "].diffuse", pointLight.diffuse);
-            shaderLightingPass.setVec3("lightsSipke[" + std::to_string(i) + "].specular", pointLight.specular);
-            shaderLightingPass.setFloat("lightsSipke[" + std::to_string(i) + "].constant", pointLight.constant);
-            shaderLightingPass.setFloat("lightsSipke[" + std::to_string(i) + "].linear", pointLight.linear);
-            shaderLightingPass.setFloat("lightsSipke[" + std::to_string(i) + "].quadratic", pointLight.quadratic);
-        }
-        for (unsigned int i = 0; i < lightPositions2.size(); i++)
-        {
-            shaderLightingPass.setVec3("lightsRamovi[" + std::to_string(i) + "].position", lightPositions2[i]);
-            shaderLightingPass.setVec3("lightsRamovi[" + std::to_string(i) + "].color", glm::vec3(programState->frameLights));
-
-            shaderLightingPass.setVec3("lightsRamovi[" + std::to_string(i) + "].ambient", pointLight.ambient);
-            shaderLightingPass.setVec3("lightsRamovi[" + std::to_string(i) + "].diffuse", pointLight.diffuse);
-            shaderLightingPass.setVec3("lightsRamovi[" + std::to_string(i) + "].specular", pointLight.specular);
-            shaderLightingPass.setFloat("lightsRamovi[" + std::to_string(i) + "].constant", pointLight.constant);
-            shaderLightingPass.setFloat("lightsRamovi[" + std::to_string(i) + "].linear", pointLight.linear);
-            shaderLightingPass.setFloat("lightsRamovi[" + std::to_string(i) + "].quadratic", 0.1f);
+        FrameConstants constants;
+        constants.projection = projection;
+        constants.view = view;
+        constants.viewPos = programState->camera.Position;
+        constants.time = currentFrame;
+        constants.dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+        constants.dirLight.ambient = programState->dirLightAmbient;
+        constants.dirLight.diffuse = programState->dirLightDiffuse;
+        constants.dirLight.specular = programState->dirLightSpecular;
+        constants.exposure = programState->exposure;
+        constants.sipkeColor = sipkeColor;
+        frameConstants.Write(constants, FRAME_CONSTANTS_BINDING);
+
+        GLState::Get().DepthFunc(GL_LEQUAL);
+        if (programState->renderQueue) {
+            renderQueue.Begin(view, 0.1f, 100.0f);
+            const glm::mat4 *identity = renderQueue.Transform(glm::mat4(1.0f));
+            renderQueue.Push(RENDER_PASS_GBUFFER, shaderGeometryPass, tunel2, identity);
+            paintings.Record(renderQueue, RENDER_PASS_GBUFFER, ramovi2, shaderGeometryPass2, identity);
+            renderQueue.Submit(RENDER_PASS_GBUFFER);
+        } else {
+            shaderGeometryPass.use();
+            model = glm::mat4(1.0f);
+            model = glm::translate(model, glm::vec3(0,0,0));
+            shaderGeometryPass.setMat4("model", model);
+            tunel2.Draw(shaderGeometryPass);
+
+            shaderGeometryPass2.use();
+            model = glm::mat4(1.0f);
+            model = glm::translate(model, glm::vec3(glm::vec3(0.0f)));
+            shaderGeometryPass2.setMat4("model", model);
+            paintings.Draw(ramovi2, shaderGeometryPass2);
         }
-        for (unsigned int i = 0; i < spotLightPositions.size(); i++){
-            //spotlight
-            shaderLightingPass.setVec3("spotLight[" + std::to_string(i) + "].position", spotLightPositions[i]);
-
-            shaderLightingPass.setVec3("spotLight[" + std::to_string(i) + "].direction", spotLightDirections[i]);
-//            shaderLightingPass.setVec3("spotLight[" + std::to_string(i) + "].direction", programState->camera.Front);
-            shaderLightingPass.setVec3("spotLight[" + std::to_string(i) + "].ambient", programState->spotLight.ambient);
-            shaderLightingPass.setVec3("spotLight[" + std::to_string(i) + "].diffuse", programState->spotLight.diffuse);
-            shaderLightingPass.setVec3("spotLight[" + std::to_string(i) + "].specular", programState->spotLight.specular);
-            shaderLightingPass.setFloat("spotLight[" + std::to_string(i) + "].constant", programState->spotLight.constant);
-            shaderLightingPass.setFloat("spotLight[" + std::to_string(i) + "].linear", programState->spotLight.linear);
-            shaderLightingPass.setFloat("spotLight[" + std::to_string(i) + "].quadratic", programState->spotLight.quadratic);
-            shaderLightingPass.setFloat("spotLight[" + std::to_string(i) + "].cutOff", programState->spotLight.cutOff);
-            shaderLightingPass.setFloat("spotLight[" + std::to_string(i) + "].outerCutOff", programState->spotLight.outerCutOff);
+        GLState::Get().DepthFunc(GL_LESS);
+
 
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        if (programState->lightVolumes) {
+            // the volumes are depth tested against the scene
+            GLState::Get().BindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+            GLState::Get().BindFramebuffer(GL_DRAW_FRAMEBUFFER, hdrFBO);
+            glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
         }
-        shaderLightingPass.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        shaderLightingPass.setVec3("dirLight.ambient", programState->dirLightAmbient);
-        shaderLightingPass.setVec3("dirLight.specular", programState->dirLightSpecular);
-        shaderLightingPass.setVec3("dirLight.diffuse", programState->dirLightDiffuse);
-        shaderLightingPass.setVec3("viewPos", programState->camera.Position);
-        shaderLightingPass.setFloat("material.shininess", 32.0f);
-        //directional light
 
-        shaderLightingPass.setBool("blinn",programState->blinn);
+        lightUploadBytes = updateLightBuffers(Frustum(projection * view), programState->cullLights);
+        sipkeLights.Bind(SIPKE_LIGHTS_BINDING);
+        ramoviLights.Bind(RAMOVI_LIGHTS_BINDING);
+        spotLights.Bind(SPOT_LIGHTS_BINDING);
+        shadowAtlas.Bind(SHADOW_ATLAS_UNIT, SHADOW_TILES_BINDING);
+        // the light lists of this frame's view, before the lighting pass reads them
+        if (programState->clusteredLighting && !programState->lightVolumes)
+            clusters.Cull(*lightCulling, projection, 0.1f, 100.0f, sipkeLights.Count(), ramoviLights.Count(),
+                          spotLights.Count());
+
+        shaderLightingPass->use();
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, gPosition);
+        GLState::Get().ActiveTexture(GL_TEXTURE1);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, gNormal);
+        GLState::Get().ActiveTexture(GL_TEXTURE2);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, gAlbedoSpec);
+        GLState::Get().ActiveTexture(GL_TEXTURE3);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, gMask);
+        GLState::Get().ActiveTexture(GL_TEXTURE5);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, gBaked);
 
-        renderQuad();
+        // send light relevant uniforms
+        auto uniformStart = std::chrono::steady_clock::now();
+        if (programState->uniformHandles)
+            setLightUniformsByHandle();
+        else
+            setLightUniformsByName();
+        double uniformUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - uniformStart).count();
+        lightUniformUs = lightUniformUs == 0.0 ? uniformUs : lightUniformUs * 0.95 + uniformUs * 0.05;
+
+        lightingPasses.Timer(lightingKey).Begin();
+        if (programState->lightVolumes) {
+            // the sun over the whole screen, without touching the scene depth the volumes need
+            GLState::Get().Disable(GL_DEPTH_TEST);
+            renderQuad();
+            GLState::Get().Enable(GL_DEPTH_TEST);
+            shaderLightVolume->use();
+            shaderLightVolume->setBool("blinn", programState->blinn);
+            lightVolumes.Draw(*shaderLightVolume, sipkeLights.Count(), ramoviLights.Count(), spotLights.Count());
+        } else {
+            fullscreenFragments.Begin();
+            renderQuad();
+            fullscreenFragments.End();
+        }
+        lightingPasses.Timer(lightingKey).End();
+        sipkeLights.Fence();
+        ramoviLights.Fence();
+        spotLights.Fence();
 
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         // 2. blur bright fragments with two-pass Gaussian Blur
         // --------------------------------------------------
@@ -758,16 +1207,16 @@ int main() {
         unsigned int amount = 10;
         shaderBlur.use();
 
-        glActiveTexture(GL_TEXTURE0);
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
 
-        glDisable(GL_DEPTH_TEST);
+        GLState::Get().Disable(GL_DEPTH_TEST);
 
         for (unsigned int i = 0; i < amount; i++)
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+            GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
             glClear(GL_COLOR_BUFFER_BIT |GL_DEPTH_BUFFER_BIT);
             shaderBlur.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
+            GLState::Get().BindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
             renderQuad();
             horizontal = !horizontal;
             if (first_iteration){
@@ -776,64 +1225,63 @@ int main() {
                 first_iteration = false;
             }
         }
-        glEnable(GL_DEPTH_TEST);
+        GLState::Get().Enable(GL_DEPTH_TEST);
 
 
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        shaderBloomFinal.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, gMask);
+        shaderBloomFinal->use();
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+        GLState::Get().ActiveTexture(GL_TEXTURE1);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+        GLState::Get().ActiveTexture(GL_TEXTURE2);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, gMask);
 
-        shaderBloomFinal.setInt("bloom", programState->bloom);
-        shaderBloomFinal.setFloat("exposure", programState->exposure);
+        shaderBloomFinal->setInt("bloom", programState->bloom);
+        bloomFinals.Timer(bloomKey).Begin();
         renderQuad();
+        bloomFinals.Timer(bloomKey).End();
 
         //std::cout << "bloom: " << (programState->bloom ? "on" : "off") << "|hdr: " << (programState->hdr ? "on" : "off") << "| exposure: " << programState->exposure<<::endl;
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
+        GLState::Get().BindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+        GLState::Get().BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
         glBlitFramebuffer(
                 0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST
         );
 
-        transparentShader.use();
+        transparentShader->use();
 
-        glBindVertexArray(transparentVAO);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, transparentTexture);
+        GLState::Get().BindVertexArray(transparentVAO);
+        GLState::Get().Enable(GL_BLEND);
+        GLState::Get().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, transparentTexture);
 //
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(programState->planePosX,programState->planePosY,programState->planePosZ));
         model = glm::scale(model, glm::vec3(programState->planeScaleX,1,1));
         model = glm::scale(model, glm::vec3(1,programState->planeScaleY,1));
         model = glm::scale(model, glm::vec3(1,1,programState->planeScaleZ));
-        transparentShader.setMat4("projection", projection);
-        transparentShader.setMat4("view", view);
         float angle = 90.0f;
         model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.0f,0.0f ));
-        transparentShader.setMat4("model", model);
-        transparentShader.setBool("blinn", programState->blinn);
-
-        transparentShader.setVec3("viewPos", programState->camera.Position);
-        transparentShader.setFloat("material.shininess", 32.0f);
-        //directional light
-        transparentShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        transparentShader.setVec3("dirLight.ambient", programState->dirLightAmbient);
-        transparentShader.setVec3("dirLight.diffuse", programState->dirLightDiffuse *5.0f);
-        transparentShader.setVec3("dirLight.specular", programState->dirLightSpecular);
-
-        glDepthFunc(GL_LEQUAL);
+        transparentShader->setMat4("model", model);
+        transparentShader->setBool("blinn", programState->blinn);
+
+        transparentShader->setFloat("material.shininess", 32.0f);
+
+        GLState::Get().DepthFunc(GL_LEQUAL);
+        transparentShaders.Timer(blinnKey).Begin();
         glDrawArrays(GL_TRIANGLES, 0, 6);
+        transparentShaders.Timer(blinnKey).End();
 
-        glDisable(GL_BLEND);
+        GLState::Get().Disable(GL_BLEND);
+        // the transparent plane is the last draw that reads this frame's constants
+        frameConstants.Fence();
+        double submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+        averageSubmitMs = averageSubmitMs == 0.0 ? submitMs : averageSubmitMs * 0.95 + submitMs * 0.05;
 
 
         if (programState->ImGuiEnabled) {
@@ -862,8 +1310,144 @@ int main() {
                 ImGui::End();
             }
 
+            {
+                ImGui::Begin("Texture streaming");
+                ImGui::SliderInt("VRAM budget (MB)", &programState->textureBudgetMB, 16, 1024);
+                ImGui::Text("Streamed: %.1f MB, all textures: %.1f MB",
+                            textureStreamer.ResidentBytes() / (1024.0 * 1024.0),
+                            TextureCache::Instance().ResidentBytes() / (1024.0 * 1024.0));
+                for (const TextureStreamer::StreamedTexture &t : textureStreamer.Textures()) {
+                    const DdsLevel &l = t.dds.levels[t.residentLevel];
+                    ImGui::Text("%-28s mip %2u (%4ux%-4u) want %2u  %6.0f px  %5.2f MB",
+                                t.path.substr(t.path.find_last_of('/') + 1).c_str(), t.residentLevel, l.width, l.height,
+                                t.desiredLevel, t.projectedSize, t.residentBytes / (1024.0 * 1024.0));
+                }
+                ImGui::End();
+            }
+
+            {
+                ImGui::Begin("Render stats");
+                const RenderStats &stats = RenderStats::LastFrame();
+                ImGui::Text("Model geometry (%s)", programState->packGeometry ? "packed" : "one VAO per mesh");
+                ImGui::Text("Draw calls: %u", stats.drawCalls);
+                ImGui::Text("VAO binds: %u", stats.vertexArrayBinds);
+                ImGui::Text("Texture binds: %u (%u already bound)", stats.textureBinds, stats.textureBindsSkipped);
+                ImGui::Text("Sampler lookups avoided: %u", stats.locationQueriesSaved);
+                ImGui::Text("Shaders building: %u", shaders.PendingCount());
+                ImGui::Checkbox("Filter redundant GL state", &programState->filterGLState);
+                ImGui::Text("State calls: %u issued, %u filtered", stats.stateCalls, stats.stateCallsFiltered);
+                ImGui::Text("CPU submit: %.3f ms", averageSubmitMs);
+                ImGui::Text("CPU fence waits: %.3f ms", stats.fenceWaitMs);
+                ImGui::Text("Heap allocations: %u", stats.heapAllocations);
+                ImGui::Checkbox("Sorted render queue", &programState->renderQueue);
+                if (programState->renderQueue) {
+                    const RenderQueue::PassStats &gbuffer = renderQueue.Stats(RENDER_PASS_GBUFFER);
+                    ImGui::Text("G-buffer pass: %u commands, %u draws, %u binds, %u program switches",
+                                gbuffer.commands, gbuffer.draws, gbuffer.binds, gbuffer.programSwitches);
+                    ImGui::Text("Frame arena: %zu KB high water, %u growths",
+                                renderQueue.Arena().HighWater() / 1024, renderQueue.Arena().Growths());
+                }
+                if (paintings.Active())
+                    ImGui::Text("Paintings: %u layers, %u meshes in one indirect draw, %zu separate",
+                                paintings.Layers(), paintings.DrawCount(), paintings.SeparateCount());
+                else
+                    ImGui::Text("Paintings: one draw per mesh");
+                ImGui::End();
+            }
+
+            {
+                ImGui::Begin("Shader variants");
+                ImGui::Checkbox("Branch on uniforms (reference)", &programState->uniformBranches);
+                auto showVariant = [](unsigned int key, Shader &shader, GpuTimer &timer) {
+                    ImGui::Text("%s: %.3f ms", shader.Name().c_str(), timer.Ms());
+                };
+                lightingPasses.ForEach(showVariant);
+                bloomFinals.ForEach(showVariant);
+                transparentShaders.ForEach(showVariant);
+                lightVolumeShaders.ForEach(showVariant);
+                ImGui::End();
+            }
+
+            {
+                ImGui::Begin("Light culling");
+                ImGui::Checkbox("Cull lights against the frustum", &programState->cullLights);
+                ImGui::SliderFloat("Light cutoff", &programState->lightCutoff, 0.005f, 0.5f, "%.3f");
+                ImGui::Text("Visible lights: %u of %u", visibleLights,
+                            sipkeLights.Capacity() + ramoviLights.Capacity() + spotLights.Capacity());
+                if (LightClusters::Supported()) {
+                    ImGui::Checkbox("Clustered lighting", &programState->clusteredLighting);
+                    ImGui::Checkbox("Lights per cluster heatmap", &programState->lightHeatmap);
+                    ImGui::Text("Grid: %ux%ux%u clusters, up to %u lights each", LightClusters::CLUSTERS_X,
+                                LightClusters::CLUSTERS_Y, LightClusters::CLUSTERS_Z, LightClusters::MAX_LIGHTS_PER_CLUSTER);
+                    ImGui::Text("Cluster light lists: %.3f ms", clusters.Timer().Ms());
+                } else
+                    ImGui::Text("Compute shaders are not available, no clustered lighting");
+                // the lighting pass with each source of lights it has been drawn with, same specular model
+                ImGui::Text("Lighting pass: %.3f ms", lightingPasses.Timer(lightingKey).Ms());
+                lightingPasses.ForEach([&](unsigned int key, Shader &, GpuTimer &timer) {
+                    if (key == blinnKey)
+                        ImGui::Text("  all lights: %.3f ms", timer.Ms());
+                    else if (key == (blinnKey | VARIANT_CULLED_LIGHTS))
+                        ImGui::Text("  frustum culled: %.3f ms", timer.Ms());
+                    else if (key == (blinnKey | VARIANT_CLUSTERED))
+                        ImGui::Text("  clustered: %.3f ms", timer.Ms());
+                    else if (key == (blinnKey | VARIANT_LIGHT_VOLUMES))
+                        ImGui::Text("  light volumes: %.3f ms", timer.Ms());
+                });
+                ImGui::Checkbox("Light volumes (stencil tested)", &programState->lightVolumes);
+                // every fullscreen fragment loops over the lights, a volume fragment shades one light
+                ImGui::Text("Fullscreen pass: %.0f fragments", fullscreenFragments.Fragments());
+                ImGui::Text("Light volumes: %.0f fragments (sipke %.0f, ramovi %.0f, spot %.0f)",
+                            lightVolumes.Fragments(LightVolumes::SET_SIPKE) + lightVolumes.Fragments(LightVolumes::SET_RAMOVI) +
+                            lightVolumes.Fragments(LightVolumes::SET_SPOT),
+                            lightVolumes.Fragments(LightVolumes::SET_SIPKE), lightVolumes.Fragments(LightVolumes::SET_RAMOVI),
+                            lightVolumes.Fragments(LightVolumes::SET_SPOT));
+                ImGui::End();
+            }
+
+            {
+                ImGui::Begin("Shadow atlas");
+                ImGui::Checkbox("Spot light shadows", &programState->spotShadows);
+                ImGui::SliderInt("Tiles refreshed per frame, at most", &programState->shadowRefreshBudget, 1, 26);
+                if (ImGui::Button("Render all tiles again"))
+                    shadowAtlas.Invalidate();
+                ImGui::Text("Atlas: %ux%u, %.1f MB", shadowAtlas.Size(), shadowAtlas.Size(),
+                            shadowAtlas.Bytes() / (1024.0 * 1024.0));
+                ImGui::Text("Tiles refreshed this frame: %u, still stale: %u", shadowAtlas.TilesRefreshed(),
+                            shadowAtlas.StaleCount());
+                ImGui::Text("Tile rendering: %.3f ms", shadowAtlas.Timer().Ms());
+                ImGui::End();
+            }
+
+            {
+                ImGui::Begin("Baked lighting");
+                ImGui::Checkbox("Frame and spot lights from the lightmap", &programState->bakedLighting);
+                if (galleryLightmap.IsOpen()) {
+                    ImGui::Text("Lightmap: %ux%u, %.1f MB, %u lights baked in %.0f ms", galleryLightmap.Width(),
+                                galleryLightmap.Height(), galleryLightmap.Bytes() / (1024.0 * 1024.0),
+                                galleryLightmap.LightCount(), galleryLightmap.BakeMs());
+                    if (staleLightCount)
+                        ImGui::Text("%u lights changed since the bake, lit dynamically; run lightmap_baker",
+                                    staleLightCount);
+                    else
+                        ImGui::Text("Up to date, only the specular part is lit dynamically");
+                } else
+                    ImGui::Text("No lightmap, run lightmap_baker");
+                ImGui::End();
+            }
+
+            {
+                ImGui::Begin("Uniforms");
+                ImGui::Checkbox("Precomputed handles", &programState->uniformHandles);
+                ImGui::Text("Lighting uniforms: %.1f us/frame", lightUniformUs);
+                ImGui::Text("Light buffer upload: %zu bytes", lightUploadBytes);
+                ImGui::End();
+            }
+
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            // the backend changes program, textures, VAO and blend behind GLState's back
+            GLState::Get().Invalidate();
         }
 
 
@@ -871,17 +1455,58 @@ int main() {
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        if (firstFrame) {
+            firstFrame = false;
+            std::cout << "STARTUP::FIRST_FRAME " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count()
+                      << " ms, " << shaders.WaitedMs() << " ms of it waiting for shaders" << std::endl;
+        }
+
+        unsigned long frameAllocations = HeapCounter::Allocations() - frameStartAllocations;
+        RenderStats::Frame().heapAllocations = frameAllocations;
+        frameIndex++;
+        if (allocationTest && frameIndex > ALLOCATION_TEST_WARMUP_FRAMES) {
+            testAllocations += frameAllocations;
+            worstFrameAllocations = std::max(worstFrameAllocations, frameAllocations);
+            if (frameIndex == ALLOCATION_TEST_WARMUP_FRAMES + ALLOCATION_TEST_FRAMES)
+                glfwSetWindowShouldClose(window, true);
+        }
+    }
+    int exitCode = 0;
+    if (allocationTest) {
+        bool passed = frameIndex >= ALLOCATION_TEST_WARMUP_FRAMES + ALLOCATION_TEST_FRAMES && testAllocations == 0;
+        std::cout << "FRAME::ALLOCATION_TEST " << (passed ? "passed" : "FAILED") << ": " << testAllocations
+                  << " heap allocations in " << std::max(frameIndex - ALLOCATION_TEST_WARMUP_FRAMES, 0)
+                  << " steady state frames, at most " << worstFrameAllocations << " in one" << std::endl;
+        exitCode = passed ? 0 : 1;
     }
 
     programState->SaveToFile("resources/program_state.txt");
+    // the lights as they were left, for the next bake
+    collectStaticLights(staticLights);
+    Lightmap::WriteLights(Lightmap::LightsPathFor(galleryPath), staticLights);
     delete programState;
+    paintings.Release();
+    for (ShaderVariants *family : {&lightingPasses, &bloomFinals, &transparentShaders, &lightVolumeShaders}) {
+        family->Report();
+        family->Release();
+    }
+    sipkeLights.Release();
+    ramoviLights.Release();
+    spotLights.Release();
+    clusters.Release();
+    lightVolumes.Release();
+    shadowAtlas.Release();
+    galleryLightmap.Release();
+    fullscreenFragments.Release();
+    frameConstants.Release();
+    TextureCache::Instance().Shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
-    return 0;
+    return exitCode;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -977,7 +1602,7 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        GLState::Get().BindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -985,9 +1610,8 @@ void renderQuad()
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState::Get().BindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
 unsigned int loadTexture(char const * path, bool gammaCorrection)
 {
@@ -1015,7 +1639,7 @@ unsigned int loadTexture(char const * path, bool gammaCorrection)
             dataFormat = GL_RGBA;
         }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
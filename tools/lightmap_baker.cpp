@@ -0,0 +1,712 @@
+// Offline lightmap baker: bakes the ambient and diffuse light of the static frame (ramovi) and spot lights
+// into a lightmap for the gallery frames, so the lighting pass only adds their specular part. The geometry
+// comes from the mesh caches and the lights from <model>.lights, both written by the program when it runs,
+// so run the program once before baking. The model's triangles are grouped into charts of neighbours that
+// face about the same way, each chart is projected onto its plane and the charts are packed into the
+// lightmap. Every covered texel is then lit by every light, with shadow rays against the model and the
+// occluders. The lights are baked one after the other, each one spread over all cores.
+//
+// Every light's texels are kept in <model>.lightmap.layers. A later bake with the same geometry reuses the
+// layers of the lights that didn't change, so moving one light only bakes that light again.
+//
+// usage: lightmap_baker [--force] [--size N] [--density texels per unit] [model [occluder]...]
+//        (defaults to resources/objects/final/ramovi2.obj, with sipke2.obj next to it as occluder)
+
+#include <learnopengl/lightmap.h>
+#include <learnopengl/mesh_cache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const uint32_t LAYERS_MAGIC = 0x5259414c;   // "LAYR"
+const uint32_t LAYERS_VERSION = 1;
+// texels around every chart, so bilinear filtering at its edge doesn't reach into the next one
+const int CHART_PADDING = 2;
+// texels left empty along the lightmap's border; lightmap UV (0, 0) of the meshes that weren't baked reads
+// an uncovered texel there, which tells the lighting pass to light them dynamically
+const int LIGHTMAP_MARGIN = 4;
+// cosine of the largest angle between a triangle and the first triangle of its chart
+const float CHART_NORMAL_COS = 0.9f;
+// the shadow atlas ignores geometry this close to a spot light, the bake does the same (shadow_atlas.h)
+const float LIGHT_NEAR = 0.05f;
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// calls body(i) for every i below count, in chunks handed out to one thread per core
+template <typename Body>
+void parallelFor(size_t count, Body &&body)
+{
+    const size_t CHUNK = 256;
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    unsigned int cores = std::thread::hardware_concurrency();
+    for (unsigned int i = 0; i < std::max(1u, cores); i++)
+        workers.emplace_back([&] {
+            for (size_t begin = next.fetch_add(CHUNK); begin < count; begin = next.fetch_add(CHUNK))
+                for (size_t j = begin; j < std::min(count, begin + CHUNK); j++)
+                    body(j);
+        });
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+// a mesh the way the program loads it
+struct SceneMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+bool loadCachedModel(const std::string &path, std::vector<SceneMesh> &meshes)
+{
+    uint64_t sourceHash = MeshCache::SourceHash(path);
+    if (sourceHash == 0) {
+        std::printf("BAKER::ERROR no such model %s\n", path.c_str());
+        return false;
+    }
+    MeshCache cache;
+    if (!cache.Open(MeshCache::PathFor(path), sourceHash)) {
+        std::printf("BAKER::ERROR no current mesh cache for %s, run the program once to write it\n", path.c_str());
+        return false;
+    }
+    for (uint32_t i = 0; i < cache.MeshCount(); i++) {
+        const MeshCacheEntry &entry = cache.Entry(i);
+        SceneMesh mesh;
+        mesh.vertices.assign(cache.Vertices(i), cache.Vertices(i) + entry.vertexCount);
+        mesh.indices.assign(cache.Indices(i), cache.Indices(i) + entry.indexCount);
+        meshes.push_back(std::move(mesh));
+    }
+    return true;
+}
+
+// Bounding volume hierarchy over the scene's triangles for the shadow rays: median splits along the longest
+// axis of the centroids, up to four triangles a leaf. Inner nodes keep their first child right after them.
+class Bvh
+{
+public:
+    void Add(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    {
+        triangles.push_back({a, b - a, c - a});
+    }
+
+    void Build()
+    {
+        std::vector<unsigned int> order(triangles.size());
+        std::vector<glm::vec3> centroids(triangles.size());
+        for (size_t i = 0; i < triangles.size(); i++) {
+            order[i] = i;
+            const Triangle &t = triangles[i];
+            centroids[i] = t.a + (t.edge1 + t.edge2) / 3.0f;
+        }
+        nodes.clear();
+        nodes.reserve(triangles.size() / 2 + 1);
+        if (!triangles.empty())
+            build(order, centroids, 0, order.size());
+        std::vector<Triangle> sorted(triangles.size());
+        for (size_t i = 0; i < order.size(); i++)
+            sorted[i] = triangles[order[i]];
+        triangles.swap(sorted);
+    }
+
+    // whether anything lies on the segment from origin along direction (unit length) up to distance
+    bool Occluded(const glm::vec3 &origin, const glm::vec3 &direction, float distance) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverse = 1.0f / direction;
+        unsigned int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            glm::vec3 t0 = (node.min - origin) * inverse, t1 = (node.max - origin) * inverse;
+            glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+            float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+            float exit = std::min(std::min(far.x, far.y), std::min(far.z, distance));
+            if (enter > exit)
+                continue;
+            if (node.count) {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                    if (hit(triangles[i], origin, direction, distance))
+                        return true;
+            } else {
+                stack[top++] = node.first;
+                stack[top++] = &node - nodes.data() + 1;
+            }
+        }
+        return false;
+    }
+
+    size_t NodeCount() const { return nodes.size(); }
+    size_t TriangleCount() const { return triangles.size(); }
+
+private:
+    struct Triangle {
+        glm::vec3 a, edge1, edge2;
+    };
+    struct Node {
+        glm::vec3 min, max;
+        unsigned int first = 0;   // first triangle of a leaf, second child of an inner node
+        unsigned int count = 0;   // 0 for inner nodes
+    };
+
+    std::vector<Triangle> triangles;
+    std::vector<Node> nodes;
+
+    unsigned int build(std::vector<unsigned int> &order, const std::vector<glm::vec3> &centroids, size_t begin,
+                       size_t end)
+    {
+        unsigned int index = nodes.size();
+        nodes.push_back(Node());
+        glm::vec3 min(1e30f), max(-1e30f), centroidMin(1e30f), centroidMax(-1e30f);
+        for (size_t i = begin; i < end; i++) {
+            const Triangle &t = triangles[order[i]];
+            for (const glm::vec3 &p : {t.a, t.a + t.edge1, t.a + t.edge2}) {
+                min = glm::min(min, p);
+                max = glm::max(max, p);
+            }
+            centroidMin = glm::min(centroidMin, centroids[order[i]]);
+            centroidMax = glm::max(centroidMax, centroids[order[i]]);
+        }
+        nodes[index].min = min;
+        nodes[index].max = max;
+        if (end - begin <= 4) {
+            nodes[index].first = begin;
+            nodes[index].count = end - begin;
+            return index;
+        }
+        glm::vec3 extent = centroidMax - centroidMin;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        size_t middle = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+        build(order, centroids, begin, middle);
+        unsigned int second = build(order, centroids, middle, end);
+        nodes[index].first = second;
+        return index;
+    }
+
+    // Moller-Trumbore, both faces
+    static bool hit(const Triangle &t, const glm::vec3 &origin, const glm::vec3 &direction, float distance)
+    {
+        glm::vec3 p = glm::cross(direction, t.edge2);
+        float determinant = glm::dot(t.edge1, p);
+        if (std::abs(determinant) < 1e-12f)
+            return false;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - t.a;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, t.edge1);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float distanceHit = glm::dot(t.edge2, q) * inverse;
+        return distanceHit > 0.0f && distanceHit < distance;
+    }
+};
+
+// triangles of one mesh that are unwrapped together, projected onto the plane of the first one
+struct Chart {
+    unsigned int mesh = 0;
+    std::vector<unsigned int> triangles;
+    glm::vec3 tangent, bitangent;
+    glm::vec2 min, max;                         // of the projected corners, in world units
+    int x = 0, y = 0, width = 0, height = 0;    // place in the lightmap in texels, padding included
+
+    glm::vec2 Project(const glm::vec3 &position) const
+    {
+        return glm::vec2(glm::dot(position, tangent), glm::dot(position, bitangent));
+    }
+};
+
+uint64_t positionKey(const glm::vec3 &position)
+{
+    return HashBytes(&position, sizeof(glm::vec3));
+}
+
+// grows charts across edges shared by position (vertices on a UV or normal seam are separate vertices but
+// still connect) as long as the triangles face within acos(CHART_NORMAL_COS) of the chart's first one
+void buildCharts(unsigned int meshIndex, const SceneMesh &mesh, std::vector<Chart> &charts)
+{
+    size_t triangleCount = mesh.indices.size() / 3;
+    std::vector<glm::vec3> normals(triangleCount);
+    std::vector<uint64_t> corners(mesh.indices.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        const glm::vec3 &a = mesh.vertices[mesh.indices[t * 3]].Position;
+        const glm::vec3 &b = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+        const glm::vec3 &c = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        normals[t] = length > 1e-12f ? normal / length : glm::vec3(0.0f);
+        for (int k = 0; k < 3; k++)
+            corners[t * 3 + k] = positionKey(mesh.vertices[mesh.indices[t * 3 + k]].Position);
+    }
+    std::unordered_map<uint64_t, std::vector<unsigned int>> edges;
+    auto edgeKey = [&](size_t t, int k) {
+        uint64_t a = corners[t * 3 + k], b = corners[t * 3 + (k + 1) % 3];
+        return a < b ? HashBytes(&b, 8, a) : HashBytes(&a, 8, b);
+    };
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            edges[edgeKey(t, k)].push_back(t);
+
+    std::vector<bool> assigned(triangleCount, false);
+    std::vector<unsigned int> queue;
+    for (size_t seed = 0; seed < triangleCount; seed++) {
+        if (assigned[seed])
+            continue;
+        Chart chart;
+        chart.mesh = meshIndex;
+        glm::vec3 normal = normals[seed];
+        // degenerate triangles take the orientation of whichever chart reaches them first
+        bool degenerate = normal == glm::vec3(0.0f);
+        if (degenerate)
+            normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        queue.assign(1, seed);
+        assigned[seed] = true;
+        while (!queue.empty()) {
+            unsigned int t = queue.back();
+            queue.pop_back();
+            chart.triangles.push_back(t);
+            for (int k = 0; k < 3; k++)
+                for (unsigned int neighbour : edges[edgeKey(t, k)]) {
+                    if (assigned[neighbour])
+                        continue;
+                    bool flat = normals[neighbour] == glm::vec3(0.0f);
+                    if (!flat && (degenerate || glm::dot(normals[neighbour], normal) < CHART_NORMAL_COS))
+                        continue;
+                    assigned[neighbour] = true;
+                    queue.push_back(neighbour);
+                }
+        }
+        // triangles in their original order, so the rebuilt index buffer keeps the optimizer's order
+        std::sort(chart.triangles.begin(), chart.triangles.end());
+        glm::vec3 up = std::abs(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        chart.tangent = glm::normalize(glm::cross(up, normal));
+        chart.bitangent = glm::cross(normal, chart.tangent);
+        chart.min = glm::vec2(1e30f);
+        chart.max = glm::vec2(-1e30f);
+        for (unsigned int t : chart.triangles)
+            for (int k = 0; k < 3; k++) {
+                glm::vec2 p = chart.Project(mesh.vertices[mesh.indices[t * 3 + k]].Position);
+                chart.min = glm::min(chart.min, p);
+                chart.max = glm::max(chart.max, p);
+            }
+        charts.push_back(std::move(chart));
+    }
+}
+
+// shelf packing, tallest charts first; false when they don't fit at this density
+bool packCharts(std::vector<Chart> &charts, int size, float density)
+{
+    std::vector<unsigned int> order(charts.size());
+    for (Chart &chart : charts) {
+        glm::vec2 extent = (chart.max - chart.min) * density;
+        chart.width = std::max(1, (int)std::ceil(extent.x)) + 2 * CHART_PADDING;
+        chart.height = std::max(1, (int)std::ceil(extent.y)) + 2 * CHART_PADDING;
+        if (chart.width > size - 2 * LIGHTMAP_MARGIN || chart.height > size - 2 * LIGHTMAP_MARGIN)
+            return false;
+    }
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](unsigned int a, unsigned int b) { return charts[a].height > charts[b].height; });
+    int x = LIGHTMAP_MARGIN, y = LIGHTMAP_MARGIN, shelf = 0;
+    for (unsigned int i : order) {
+        Chart &chart = charts[i];
+        if (x + chart.width > size - LIGHTMAP_MARGIN) {
+            x = LIGHTMAP_MARGIN;
+            y += shelf;
+            shelf = 0;
+        }
+        chart.x = x;
+        chart.y = y;
+        x += chart.width;
+        shelf = std::max(shelf, chart.height);
+    }
+    return y + shelf <= size - LIGHTMAP_MARGIN;
+}
+
+// a covered texel and the surface point it lights
+struct Sample {
+    unsigned int texel;
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// the lightmap vertices and indices of every mesh, and the samples of every texel a triangle covers.
+// A texel belongs to the first triangle that covers its center; a triangle that covers no center at all
+// still gets the texel under its centroid when that is free, so thin triangles aren't left unbaked.
+void unwrap(const std::vector<SceneMesh> &meshes, const std::vector<Chart> &charts, int size, float density,
+            Lightmap::Bake &bake, std::vector<Sample> &samples)
+{
+    std::vector<int> owner((size_t)size * size, -1);
+    for (unsigned int m = 0; m < meshes.size(); m++) {
+        const SceneMesh &mesh = meshes[m];
+        size_t triangleCount = mesh.indices.size() / 3;
+        std::vector<const Chart *> triangleChart(triangleCount, nullptr);
+        for (const Chart &chart : charts)
+            if (chart.mesh == m)
+                for (unsigned int t : chart.triangles)
+                    triangleChart[t] = &chart;
+
+        LightmapMesh entry = {};
+        entry.geometryHash = HashMeshGeometry(mesh.vertices, mesh.indices);
+        entry.firstVertex = bake.vertices.size();
+        entry.firstIndex = bake.indices.size();
+        std::unordered_map<uint64_t, unsigned int> remap;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const Chart &chart = *triangleChart[t];
+            glm::vec2 texelCorners[3];
+            for (int k = 0; k < 3; k++) {
+                unsigned int source = mesh.indices[t * 3 + k];
+                glm::vec2 local = (chart.Project(mesh.vertices[source].Position) - chart.min) * density;
+                texelCorners[k] = glm::vec2(chart.x, chart.y) + glm::vec2((float)CHART_PADDING) + local;
+                // one lightmap vertex per loaded vertex and chart, numbered in first use order
+                uint64_t key = ((uint64_t)(&chart - charts.data()) << 32) | source;
+                auto found = remap.find(key);
+                if (found == remap.end()) {
+                    found = remap.emplace(key, entry.vertexCount++).first;
+                    bake.vertices.push_back({source, texelCorners[k] / (float)size});
+                }
+                bake.indices.push_back(found->second);
+            }
+
+            const Vertex &a = mesh.vertices[mesh.indices[t * 3]];
+            const Vertex &b = mesh.vertices[mesh.indices[t * 3 + 1]];
+            const Vertex &c = mesh.vertices[mesh.indices[t * 3 + 2]];
+            auto addSample = [&](int x, int y, float wa, float wb, float wc) {
+                size_t texel = (size_t)y * size + x;
+                if (owner[texel] >= 0)
+                    return;
+                owner[texel] = samples.size();
+                glm::vec3 normal = wa * a.Normal + wb * b.Normal + wc * c.Normal;
+                if (glm::dot(normal, normal) < 1e-12f)
+                    normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+                if (glm::dot(normal, normal) < 1e-24f)
+                    normal = glm::vec3(0.0f, 1.0f, 0.0f);
+                samples.push_back({(unsigned int)texel, wa * a.Position + wb * b.Position + wc * c.Position,
+                                   glm::normalize(normal)});
+            };
+            glm::vec2 p0 = texelCorners[0], p1 = texelCorners[1], p2 = texelCorners[2];
+            float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+            bool covered = false;
+            if (std::abs(area) > 1e-8f) {
+                int x0 = std::max(0, (int)std::floor(std::min({p0.x, p1.x, p2.x})));
+                int x1 = std::min(size - 1, (int)std::ceil(std::max({p0.x, p1.x, p2.x})));
+                int y0 = std::max(0, (int)std::floor(std::min({p0.y, p1.y, p2.y})));
+                int y1 = std::min(size - 1, (int)std::ceil(std::max({p0.y, p1.y, p2.y})));
+                for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++) {
+                        glm::vec2 p(x + 0.5f, y + 0.5f);
+                        float wa = ((p1.x - p.x) * (p2.y - p.y) - (p2.x - p.x) * (p1.y - p.y)) / area;
+                        float wb = ((p2.x - p.x) * (p0.y - p.y) - (p0.x - p.x) * (p2.y - p.y)) / area;
+                        float wc = 1.0f - wa - wb;
+                        if (wa < -1e-4f || wb < -1e-4f || wc < -1e-4f)
+                            continue;
+                        covered = true;
+                        addSample(x, y, wa, wb, wc);
+                    }
+            }
+            if (!covered) {
+                glm::vec2 centroid = (p0 + p1 + p2) / 3.0f;
+                int x = std::min(size - 1, std::max(0, (int)centroid.x));
+                int y = std::min(size - 1, std::max(0, (int)centroid.y));
+                addSample(x, y, 1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 3.0f);
+            }
+        }
+        entry.indexCount = bake.indices.size() - entry.firstIndex;
+        bake.meshes.push_back(entry);
+    }
+}
+
+// one light's part of the lightmap, only the samples it reaches
+struct Layer {
+    uint64_t key = 0;                  // the light and the layout it was baked for
+    double bakeMs = 0.0;
+    std::vector<unsigned int> samples;
+    std::vector<glm::vec3> light;
+};
+
+// the ambient and diffuse terms of CalcPointLight/CalcSpotLight in 8.1.deferred_shading.fs without the
+// albedo, the diffuse one shadowed
+Layer bakeLight(const LightmapLight &light, const std::vector<Sample> &samples, const Bvh &bvh, float bias)
+{
+    std::vector<glm::vec3> dense(samples.size());
+    glm::vec3 spotDirection = light.type == LIGHTMAP_SPOT ? glm::normalize(light.direction) : glm::vec3(0.0f);
+    parallelFor(samples.size(), [&](size_t i) {
+        const Sample &sample = samples[i];
+        glm::vec3 toLight = light.position - sample.position;
+        float distance = glm::length(toLight);
+        if (distance >= light.radius || distance < 1e-6f) {
+            dense[i] = glm::vec3(0.0f);
+            return;
+        }
+        glm::vec3 lightDir = toLight / distance;
+        float ratio = distance / light.radius;
+        float window = glm::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+        float attenuation = window * window /
+                            (light.constant + light.linear * distance + light.quadratic * distance * distance);
+        glm::vec3 result = light.ambient * attenuation;
+        float diff = std::max(glm::dot(sample.normal, lightDir), 0.0f);
+        float intensity = 1.0f;
+        if (light.type == LIGHTMAP_SPOT) {
+            float theta = glm::dot(-lightDir, spotDirection);
+            intensity = glm::clamp((theta - light.outerCutOff) / (light.cutOff - light.outerCutOff), 0.0f, 1.0f);
+        }
+        if (diff > 0.0f && intensity > 0.0f) {
+            glm::vec3 origin = sample.position + sample.normal * bias;
+            glm::vec3 toLightFromOrigin = light.position - origin;
+            float reach = glm::length(toLightFromOrigin) - LIGHT_NEAR;
+            if (reach <= 0.0f || !bvh.Occluded(origin, toLightFromOrigin / (reach + LIGHT_NEAR), reach))
+                result += light.diffuse * diff * attenuation * intensity;
+        }
+        dense[i] = result;
+    });
+    Layer layer;
+    for (size_t i = 0; i < dense.size(); i++)
+        if (dense[i] != glm::vec3(0.0f)) {
+            layer.samples.push_back(i);
+            layer.light.push_back(dense[i]);
+        }
+    return layer;
+}
+
+// layers of an earlier bake with the same layout, by key
+std::unordered_map<uint64_t, Layer> readLayers(const std::string &path, uint64_t layoutHash, size_t sampleCount)
+{
+    std::unordered_map<uint64_t, Layer> layers;
+    std::ifstream in(path, std::ios::binary);
+    uint32_t head[3];
+    uint64_t hash;
+    if (!in.read(reinterpret_cast<char *>(head), sizeof(head)) || !in.read(reinterpret_cast<char *>(&hash), 8) ||
+        head[0] != LAYERS_MAGIC || head[1] != LAYERS_VERSION || hash != layoutHash)
+        return layers;
+    for (uint32_t l = 0; l < head[2]; l++) {
+        Layer layer;
+        uint32_t count;
+        if (!in.read(reinterpret_cast<char *>(&layer.key), 8) || !in.read(reinterpret_cast<char *>(&layer.bakeMs), 8) ||
+            !in.read(reinterpret_cast<char *>(&count), 4) || count > sampleCount)
+            return {};
+        layer.samples.resize(count);
+        layer.light.resize(count);
+        in.read(reinterpret_cast<char *>(layer.samples.data()), count * sizeof(unsigned int));
+        in.read(reinterpret_cast<char *>(layer.light.data()), count * sizeof(glm::vec3));
+        if (!in)
+            return {};
+        for (unsigned int sample : layer.samples)
+            if (sample >= sampleCount)
+                return {};
+        layers[layer.key] = std::move(layer);
+    }
+    return layers;
+}
+
+bool writeLayers(const std::string &path, uint64_t layoutHash, const std::vector<Layer> &layers)
+{
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    uint32_t head[3] = {LAYERS_MAGIC, LAYERS_VERSION, (uint32_t)layers.size()};
+    out.write(reinterpret_cast<const char *>(head), sizeof(head));
+    out.write(reinterpret_cast<const char *>(&layoutHash), 8);
+    for (const Layer &layer : layers) {
+        uint32_t count = layer.samples.size();
+        out.write(reinterpret_cast<const char *>(&layer.key), 8);
+        out.write(reinterpret_cast<const char *>(&layer.bakeMs), 8);
+        out.write(reinterpret_cast<const char *>(&count), 4);
+        out.write(reinterpret_cast<const char *>(layer.samples.data()), count * sizeof(unsigned int));
+        out.write(reinterpret_cast<const char *>(layer.light.data()), count * sizeof(glm::vec3));
+    }
+    out.close();
+    if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// grows the covered texels into the padding around them, so filtering at a chart's edge doesn't fetch black
+void dilate(std::vector<glm::vec4> &texels, int size, int passes)
+{
+    std::vector<glm::vec4> next;
+    for (int pass = 0; pass < passes; pass++) {
+        next = texels;
+        for (int y = 0; y < size; y++)
+            for (int x = 0; x < size; x++) {
+                if (texels[(size_t)y * size + x].a > 0.0f)
+                    continue;
+                glm::vec3 sum(0.0f);
+                int count = 0;
+                for (int dy = -1; dy <= 1; dy++)
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= size || ny >= size)
+                            continue;
+                        const glm::vec4 &neighbour = texels[(size_t)ny * size + nx];
+                        if (neighbour.a > 0.0f) {
+                            sum += glm::vec3(neighbour);
+                            count++;
+                        }
+                    }
+                if (count)
+                    next[(size_t)y * size + x] = glm::vec4(sum / (float)count, 1.0f);
+            }
+        texels.swap(next);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool force = false;
+    int size = 1024;
+    float density = 32.0f;
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--force")
+            force = true;
+        else if (arg == "--size" && i + 1 < argc)
+            size = std::max(64, std::atoi(argv[++i]));
+        else if (arg == "--density" && i + 1 < argc)
+            density = std::max(0.01f, (float)std::atof(argv[++i]));
+        else if (!arg.empty() && arg[0] == '-') {
+            std::printf("usage: lightmap_baker [--force] [--size N] [--density texels per unit] [model [occluder]...]\n");
+            return 1;
+        } else
+            models.push_back(arg);
+    }
+    if (models.empty())
+        models = {"resources/objects/final/ramovi2.obj", "resources/objects/final/sipke2.obj"};
+    const std::string &modelPath = models[0];
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<LightmapLight> lights;
+    if (!Lightmap::ReadLights(Lightmap::LightsPathFor(modelPath), lights)) {
+        std::printf("BAKER::ERROR no lights in %s, run the program once to write them\n",
+                    Lightmap::LightsPathFor(modelPath).c_str());
+        return 1;
+    }
+    std::vector<SceneMesh> meshes, occluders;
+    if (!loadCachedModel(modelPath, meshes))
+        return 1;
+    for (size_t i = 1; i < models.size(); i++)
+        if (!loadCachedModel(models[i], occluders))
+            return 1;
+
+    // charts, and the highest density up to the asked one at which they fit
+    std::vector<Chart> charts;
+    for (unsigned int m = 0; m < meshes.size(); m++)
+        buildCharts(m, meshes[m], charts);
+    while (!packCharts(charts, size, density)) {
+        density *= 0.9f;
+        if (density < 0.01f) {
+            std::printf("BAKER::ERROR the charts don't fit into %dx%d\n", size, size);
+            return 1;
+        }
+    }
+    Lightmap::Bake bake;
+    bake.width = bake.height = size;
+    bake.lights = lights;
+    std::vector<Sample> samples;
+    unwrap(meshes, charts, size, density, bake, samples);
+    size_t loadedVertices = 0;
+    for (const SceneMesh &mesh : meshes)
+        loadedVertices += mesh.vertices.size();
+    std::printf("%s: %zu charts at %.2f texels per unit, %zu of %d texels covered (%.1f%%), vertices %zu -> %zu\n",
+                modelPath.c_str(), charts.size(), density, samples.size(), size * size,
+                100.0 * samples.size() / ((double)size * size), loadedVertices, bake.vertices.size());
+
+    Bvh bvh;
+    for (const std::vector<SceneMesh> *set : {&meshes, &occluders})
+        for (const SceneMesh &mesh : *set)
+            for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+                bvh.Add(mesh.vertices[mesh.indices[t]].Position, mesh.vertices[mesh.indices[t + 1]].Position,
+                        mesh.vertices[mesh.indices[t + 2]].Position);
+    auto bvhStart = std::chrono::steady_clock::now();
+    bvh.Build();
+    std::printf("shadow rays against %zu triangles, %zu BVH nodes built in %.1f ms\n", bvh.TriangleCount(),
+                bvh.NodeCount(), elapsedMs(bvhStart));
+
+    // the layers depend on the samples (the geometry and its layout) and the occluders besides their light
+    uint64_t layoutHash = HashBytes(&density, sizeof(density), HashBytes(&size, sizeof(size)));
+    for (const LightmapMesh &entry : bake.meshes)
+        layoutHash = HashBytes(&entry.geometryHash, 8, layoutHash);
+    for (const SceneMesh &mesh : occluders) {
+        uint64_t hash = HashMeshGeometry(mesh.vertices, mesh.indices);
+        layoutHash = HashBytes(&hash, 8, layoutHash);
+    }
+    std::string lightmapPath = Lightmap::PathFor(modelPath);
+    std::string layersPath = lightmapPath + ".layers";
+    std::unordered_map<uint64_t, Layer> cached;
+    if (!force)
+        cached = readLayers(layersPath, layoutHash, samples.size());
+
+    // half a texel off the surface, so a texel doesn't shadow itself
+    float bias = std::max(0.5f / density, 0.005f);
+    std::vector<Layer> layers;
+    double bakedMs = 0.0, cachedMs = 0.0;
+    unsigned int rebaked = 0;
+    for (size_t i = 0; i < lights.size(); i++) {
+        const LightmapLight &light = lights[i];
+        uint64_t key = HashBytes(&light, sizeof(LightmapLight), layoutHash);
+        auto found = cached.find(key);
+        bool reused = found != cached.end();
+        if (reused) {
+            layers.push_back(std::move(found->second));
+            cachedMs += layers.back().bakeMs;
+        } else {
+            auto lightStart = std::chrono::steady_clock::now();
+            layers.push_back(bakeLight(light, samples, bvh, bias));
+            layers.back().key = key;
+            layers.back().bakeMs = elapsedMs(lightStart);
+            bakedMs += layers.back().bakeMs;
+            rebaked++;
+        }
+        std::printf("light %2zu %-5s at (%7.2f, %6.2f, %7.2f) radius %5.2f: %8.1f ms, %7zu texels%s\n", i,
+                    light.type == LIGHTMAP_SPOT ? "spot" : "point", light.position.x, light.position.y,
+                    light.position.z, light.radius, layers.back().bakeMs, layers.back().samples.size(),
+                    reused ? " (unchanged, from the last bake)" : "");
+    }
+
+    std::vector<glm::vec4> texels((size_t)size * size, glm::vec4(0.0f));
+    for (const Sample &sample : samples)
+        texels[sample.texel].a = 1.0f;
+    for (const Layer &layer : layers)
+        for (size_t i = 0; i < layer.samples.size(); i++)
+            texels[samples[layer.samples[i]].texel] += glm::vec4(layer.light[i], 0.0f);
+    dilate(texels, size, CHART_PADDING);
+    bake.texels.resize(texels.size() * 4);
+    for (size_t i = 0; i < texels.size(); i++)
+        for (int c = 0; c < 4; c++)
+            bake.texels[i * 4 + c] = FloatToHalf(texels[i][c]);
+    bake.bakeMs = bakedMs + cachedMs;
+
+    if (!Lightmap::Write(lightmapPath, bake)) {
+        std::printf("BAKER::ERROR failed to write %s\n", lightmapPath.c_str());
+        return 1;
+    }
+    if (!writeLayers(layersPath, layoutHash, layers))
+        std::printf("BAKER::ERROR failed to write %s, the next bake starts over\n", layersPath.c_str());
+    std::printf("total: %u of %zu lights baked in %.1f ms (%.1f ms of unchanged lights reused), %s written in %.1f ms\n",
+                rebaked, lights.size(), bakedMs, cachedMs, lightmapPath.c_str(), elapsedMs(start));
+    return 0;
+}
@@ -0,0 +1,373 @@
+// Offline texture cooker: converts the gallery's JPEG/PNG textures into DDS files holding
+// block compressed data (DXT1/BC1 for opaque images, DXT5/BC3 when there is alpha) with a
+// precomputed mip chain. The runtime TextureLoader picks up <name>.dds next to <name>.jpg
+// and uploads it with glCompressedTexImage2D instead of decoding the JPEG and running glGenerateMipmap.
+//
+// usage: texture_cooker [image or directory]...   (defaults to resources/objects/final)
+
+#include <learnopengl/dds.h>
+#include <stb_image.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Image {
+    int width = 0, height = 0;
+    std::vector<unsigned char> rgba;  // always 4 channels
+};
+
+struct CookResult {
+    std::string path;
+    bool ok = false;
+    bool alpha = false;
+    int width = 0, height = 0;
+    size_t uncompressedBytes = 0;  // RGB8/RGBA8 with a full mip chain, what the JPEG path keeps in VRAM
+    size_t compressedBytes = 0;
+    double decodeMs = 0.0;         // stb_image decode, the part of the JPEG path that runs on the CPU
+    double ddsReadMs = 0.0;        // reading the cooked file back
+    double cookMs = 0.0;
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 2x2 box filter, odd edges clamp to the last texel
+Image downsample(const Image &src)
+{
+    Image dst;
+    dst.width = std::max(1, src.width / 2);
+    dst.height = std::max(1, src.height / 2);
+    dst.rgba.resize((size_t)dst.width * dst.height * 4);
+    for (int y = 0; y < dst.height; y++) {
+        int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+        for (int x = 0; x < dst.width; x++) {
+            int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+            for (int c = 0; c < 4; c++) {
+                int sum = src.rgba[((size_t)y0 * src.width + x0) * 4 + c] + src.rgba[((size_t)y0 * src.width + x1) * 4 + c] +
+                          src.rgba[((size_t)y1 * src.width + x0) * 4 + c] + src.rgba[((size_t)y1 * src.width + x1) * 4 + c];
+                dst.rgba[((size_t)y * dst.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+uint16_t packRgb565(int r, int g, int b)
+{
+    return (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+void unpackRgb565(uint16_t c, int rgb[3])
+{
+    rgb[0] = ((c >> 11) & 31) * 255 / 31;
+    rgb[1] = ((c >> 5) & 63) * 255 / 63;
+    rgb[2] = (c & 31) * 255 / 31;
+}
+
+// BC1 color block: endpoints from the inset bounding box of the block (flipped along red/blue when
+// those channels run against green), indices by nearest palette entry. Always uses the 4 color mode.
+void encodeColorBlock(const unsigned char block[16][4], unsigned char out[8])
+{
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    int mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], (int)block[i][c]);
+            hi[c] = std::max(hi[c], (int)block[i][c]);
+            mean[c] += block[i][c];
+        }
+    for (int c = 0; c < 3; c++)
+        mean[c] /= 16;
+    // covariance of red and blue against green decides the diagonal of the box to use
+    int covRG = 0, covBG = 0;
+    for (int i = 0; i < 16; i++) {
+        int dg = block[i][1] - mean[1];
+        covRG += (block[i][0] - mean[0]) * dg;
+        covBG += (block[i][2] - mean[2]) * dg;
+    }
+    for (int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] = std::min(255, lo[c] + inset);
+        hi[c] = std::max(0, hi[c] - inset);
+    }
+    if (covRG < 0)
+        std::swap(lo[0], hi[0]);
+    if (covBG < 0)
+        std::swap(lo[2], hi[2]);
+
+    uint16_t c0 = packRgb565(hi[0], hi[1], hi[2]);
+    uint16_t c1 = packRgb565(lo[0], lo[1], lo[2]);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        unpackRgb565(c0, palette[0]);
+        unpackRgb565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// BC3 alpha block in the 8 value mode
+void encodeAlphaBlock(const unsigned char block[16][4], unsigned char out[8])
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = std::max(a0, (int)block[i][3]);
+        a1 = std::min(a1, (int)block[i][3]);
+    }
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    uint64_t indices = 0;
+    if (a0 != a1) {
+        int palette[8] = {a0, a1};
+        for (int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 8; p++) {
+                int distance = std::abs(block[i][3] - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+void compressLevel(const Image &image, DdsFormat format, std::vector<unsigned char> &out)
+{
+    unsigned char block[16][4];
+    for (int by = 0; by < image.height; by += 4)
+        for (int bx = 0; bx < image.width; bx += 4) {
+            for (int y = 0; y < 4; y++)
+                for (int x = 0; x < 4; x++) {
+                    int sx = std::min(bx + x, image.width - 1), sy = std::min(by + y, image.height - 1);
+                    std::memcpy(block[y * 4 + x], &image.rgba[((size_t)sy * image.width + sx) * 4], 4);
+                }
+            unsigned char encoded[16];
+            if (format == DdsFormat::BC3) {
+                encodeAlphaBlock(block, encoded);
+                encodeColorBlock(block, encoded + 8);
+            } else {
+                encodeColorBlock(block, encoded);
+            }
+            out.insert(out.end(), encoded, encoded + DdsBlockBytes(format));
+        }
+}
+
+bool writeDds(const std::string &path, DdsFormat format, int width, int height, uint32_t levels,
+              const std::vector<unsigned char> &data)
+{
+    DdsHeader header = {};
+    header.size = sizeof(DdsHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.width = width;
+    header.height = height;
+    header.pitchOrLinearSize = DdsLevelSize(format, width, height);
+    header.mipMapCount = levels;
+    header.pixelFormat.size = sizeof(DdsPixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = format == DdsFormat::BC1 ? DDS_FOURCC_DXT1 : DDS_FOURCC_DXT5;
+    header.caps = DDSCAPS_COMPLEX | DDSCAPS_TEXTURE | DDSCAPS_MIPMAP;
+
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char *>(&DDS_MAGIC), 4);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    out.close();
+    if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+CookResult cook(const std::string &path)
+{
+    CookResult result;
+    result.path = path;
+    auto start = std::chrono::steady_clock::now();
+
+    // decode the way the runtime does, so the timing below is a fair comparison
+    int width, height, nrComponents;
+    auto decodeStart = std::chrono::steady_clock::now();
+    unsigned char *native = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+    result.decodeMs = elapsedMs(decodeStart);
+    if (!native) {
+        std::printf("COOKER::ERROR failed to decode %s\n", path.c_str());
+        return result;
+    }
+    stbi_image_free(native);
+
+    unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &nrComponents, 4);
+    if (!pixels)
+        return result;
+    Image level;
+    level.width = width;
+    level.height = height;
+    level.rgba.assign(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+
+    result.width = width;
+    result.height = height;
+    result.alpha = nrComponents == 2 || nrComponents == 4;
+    DdsFormat format = result.alpha ? DdsFormat::BC3 : DdsFormat::BC1;
+
+    std::vector<unsigned char> data;
+    uint32_t levels = 0;
+    while (true) {
+        compressLevel(level, format, data);
+        result.uncompressedBytes += (size_t)level.width * level.height * nrComponents;
+        levels++;
+        if (level.width == 1 && level.height == 1)
+            break;
+        level = downsample(level);
+    }
+    result.compressedBytes = data.size();
+
+    std::string ddsPath = DdsPathFor(path);
+    if (!writeDds(ddsPath, format, width, height, levels, data)) {
+        std::printf("COOKER::ERROR failed to write %s\n", ddsPath.c_str());
+        return result;
+    }
+    result.cookMs = elapsedMs(start);
+
+    // read it back the way the runtime does to time the cooked path
+    auto readStart = std::chrono::steady_clock::now();
+    std::ifstream in(ddsPath, std::ios::binary);
+    std::vector<unsigned char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    DdsImage image;
+    result.ok = DdsParse(file.data(), file.size(), image) && image.levels.size() == levels;
+    result.ddsReadMs = elapsedMs(readStart);
+    return result;
+}
+
+bool hasImageExtension(const std::string &name)
+{
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string ext = name.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "tga" || ext == "bmp";
+}
+
+void collect(const std::string &path, std::vector<std::string> &files)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        std::printf("COOKER::ERROR no such file %s\n", path.c_str());
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        files.push_back(path);
+        return;
+    }
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    while (dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (hasImageExtension(name))
+            files.push_back(path + "/" + name);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    // the runtime flips every image on load, the cooked data has to match
+    stbi_set_flip_vertically_on_load(true);
+
+    std::vector<std::string> files;
+    if (argc < 2)
+        collect("resources/objects/final", files);
+    for (int i = 1; i < argc; i++)
+        collect(argv[i], files);
+    if (files.empty()) {
+        std::printf("usage: texture_cooker [image or directory]...\n");
+        return 1;
+    }
+
+    std::vector<CookResult> results(files.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    unsigned int cores = std::thread::hardware_concurrency();
+    for (unsigned int i = 0; i < std::max(1u, cores); i++)
+        workers.emplace_back([&] {
+            for (size_t f = next++; f < files.size(); f = next++)
+                results[f] = cook(files[f]);
+        });
+    for (std::thread &worker : workers)
+        worker.join();
+
+    size_t totalUncompressed = 0, totalCompressed = 0;
+    double totalDecode = 0.0, totalRead = 0.0;
+    int failed = 0;
+    for (const CookResult &r : results) {
+        if (!r.ok) {
+            failed++;
+            continue;
+        }
+        std::printf("%-50s %5dx%-5d %s  VRAM %7.2f MB -> %6.2f MB (%4.1fx)  load %7.2f ms -> %6.2f ms  (cooked in %.0f ms)\n",
+                    r.path.c_str(), r.width, r.height, r.alpha ? "DXT5" : "DXT1",
+                    r.uncompressedBytes / (1024.0 * 1024.0), r.compressedBytes / (1024.0 * 1024.0),
+                    (double)r.uncompressedBytes / r.compressedBytes, r.decodeMs, r.ddsReadMs, r.cookMs);
+        totalUncompressed += r.uncompressedBytes;
+        totalCompressed += r.compressedBytes;
+        totalDecode += r.decodeMs;
+        totalRead += r.ddsReadMs;
+    }
+    std::printf("total: %zu textures, VRAM %.2f MB -> %.2f MB, CPU load %.1f ms -> %.1f ms%s\n",
+                results.size() - failed, totalUncompressed / (1024.0 * 1024.0), totalCompressed / (1024.0 * 1024.0),
+                totalDecode, totalRead, failed ? " (some textures failed)" : "");
+    return failed ? 1 : 0;
+}